@@ -7,6 +7,10 @@
 #include <XBee.h>
 #include <TinyGPS++.h>
 #include <SD.h>
+#include "protocol.h"
+#include "xbeetrace.h"
+#include "fmt.h"
+#include "rtcedge.h"
 
 // These are the four touchscreen analog pins
 #define YP A9 // must be an analog pin, use "An" notation!
@@ -39,10 +43,9 @@ Adafruit_HX8357 tft = Adafruit_HX8357(TFT_CS, TFT_DC, TFT_RST);
 TouchScreen ts = TouchScreen(XP, YP, XM, YM, 321.1); //check this for new displays
 
 XBee xbee = XBee();
-char filename[13] = "ddhhmmss.csv";
+char filename[24] = "yyyymm/ddhhmmss.csv";
 const int chipSelect = BUILTIN_SDCARD;
 TxStatusResponse txStatus = TxStatusResponse();
-uint32_t oldmillis = millis();
 uint16_t buttonHeight = 96; //480 / 5;
 uint16_t buttonWidth = 160; //320 / 2;
 uint8_t clearScreen = 0;
@@ -50,41 +53,295 @@ double latitude = 0;
 double longitude = 0;
 time_t initialTime = 0;
 static int numUnits = 8;
+static const uint8_t numChannels = numPressureChannels;
+const uint32_t pollIntervalMillis = 100; //one unit is polled per interval, every unit once per numUnits intervals
+uint32_t pollMillis = 0;
+uint8_t pollIndex = 0;
+secondEdge rtcEdge; //sub second time of the log entries and the clock offsets, see rtcedge.h
 
-void writeData()
+//called before the rtc time is used and while loop() is blocked
+void updateSecondEdge()
 {
-  time_t t = Teensy3Clock.get();
-  // make a string for assembling the data to log:
-  String dataString = "";
-  dataString += String(t);
-  dataString += ".";
-  dataString += String(millis()%1000);
-  dataString += " , ";
-  dataString += String(latitude,8);
-  dataString += " , ";
-  dataString += String(longitude,8);
-
-  File dataFile = SD.open(filename, FILE_WRITE);
-  // if the file is available, write to it:
-  if (dataFile)
-  {
-    dataFile.println(dataString);
-    dataFile.close();
+  rtcEdge.update(Teensy3Clock.get(), micros());
+}
+
+enum logEntryType : uint8_t
+{
+  logGpsFix = 'G',
+  logUpdate = 'U',   //time handshake, result and the pressures the unit answered with
+  logStop = 'S',
+  logConfig = 'C',   //configuration command from the serial port
+  logTelemetry = 'T' //status poll reply
+};
+
+struct logEntry
+{
+  uint32_t time;
+  uint16_t millisecond;
+  uint8_t type;
+  uint8_t unit;
+  uint8_t result;    //0 for success, as returned by the commands of nodes
+  uint8_t parameter; //configuration parameter, or the rssi of a telemetry entry
+  int32_t values[numChannels > 5 ? numChannels : 5];
+  int64_t latitude;  //fixes in 1e-8 degrees
+  int64_t longitude;
+};
+
+//the log of the coordinator. entries are queued in RAM and written to the card a sector at a
+//time from loop(), a slow or missing card costs dropped entries instead of blocking the radio
+class logService
+{
+  public:
+  static const uint8_t queueSize = 64;
+  static const uint16_t sectorSize = 512;
+  static const uint32_t flushMillis = 1000; //a partial sector is written after this
+  static const uint32_t retryMillis = 5000; //between attempts to open the file
+  logEntry queue[queueSize];
+  uint8_t head = 0;
+  uint8_t count = 0;
+  char sector[sectorSize];
+  uint16_t length = 0;
+  File file;
+  bool isOpen = false;
+  const char *name = nullptr;
+  uint32_t lastWriteMillis = 0;
+  uint32_t lastOpenMillis = 0;
+  uint32_t dropped = 0;
+  uint32_t writeErrors = 0;
+  uint32_t lastWriteMicros = 0;
+  uint32_t maxWriteMicros = 0;
+
+  void begin(const char *fileName)
+  {
+    name = fileName;
+    lastOpenMillis = millis() - retryMillis;
   }
-  else
+
+  //opens the file at most every retryMillis. not inlined into service() so tools/heapcheck.sh
+  //can allow it: the SD library allocates the file object
+  __attribute__((noinline)) bool openFile()
+  {
+    if (name == nullptr || millis() - lastOpenMillis < retryMillis)
+      return false;
+    lastOpenMillis = millis();
+    file = SD.open(name, FILE_WRITE);
+    isOpen = (bool)file;
+    if (!isOpen)
+      writeErrors++;
+    return isOpen;
+  }
+
+  //claims a queue entry stamped with the current time, the caller fills in the rest.
+  //returns nullptr when the queue is full
+  logEntry *add(uint8_t type, uint8_t unitNumber)
+  {
+    if (count == queueSize)
+    {
+      dropped++;
+      return nullptr;
+    }
+    logEntry *e = &queue[(head + count) % queueSize];
+    count++;
+    memset(e, 0, sizeof(logEntry));
+    updateSecondEdge();
+    e->time = rtcEdge.second;
+    e->millisecond = rtcEdge.since(micros()) / 1000;
+    e->type = type;
+    e->unit = unitNumber;
+    return e;
+  }
+
+  static const uint16_t lineCapacity = 160;
+
+  static void format(const logEntry &e, fmtLine<lineCapacity> &line)
+  {
+    line.addUnsigned(e.time).addChar('.').addPadded(e.millisecond, 3).addText(" , ").addChar(e.type);
+    switch (e.type)
+    {
+    case logGpsFix:
+      line.addText(" , ").addFixed(e.latitude, 8).addText(" , ").addFixed(e.longitude, 8);
+      break;
+    case logUpdate:
+      line.addText(" , ").addUnsigned(e.unit).addText(" , ").addUnsigned(e.result);
+      for (uint8_t c = 0; c < numChannels; c++)
+        line.addText(" , ").addSigned(e.values[c]);
+      break;
+    case logStop:
+      line.addText(" , ").addUnsigned(e.unit).addText(" , ").addUnsigned(e.result);
+      break;
+    case logConfig:
+      //values[0] is the value, values[1] is 1 for a set
+      line.addText(" , ").addUnsigned(e.unit).addText(e.values[1] ? " , set , " : " , get , ").addUnsigned(e.parameter);
+      line.addText(" , ").addUnsigned(e.values[0]).addText(" , ").addUnsigned(e.result);
+      break;
+    case logTelemetry:
+      //records written, dropped readings, sd free MiB, round trip, clock offset of the unit
+      line.addText(" , ").addUnsigned(e.unit);
+      for (uint8_t v = 0; v < 5; v++)
+        line.addText(" , ").addSigned(e.values[v]);
+      line.addText(" , -").addUnsigned(e.parameter);
+      break;
+    }
+    line.addChar('\n');
+  }
+
+  //moves queued entries into the sector and writes it when it is full or old enough,
+  //at most one write per call
+  void service()
+  {
+    while (count > 0)
+    {
+      fmtLine<lineCapacity> line;
+      format(queue[head], line);
+      if (length + line.length > sectorSize)
+        break;
+      memcpy(sector + length, line.data, line.length);
+      length += line.length;
+      head = (head + 1) % queueSize;
+      count--;
+    }
+    if (length == 0 || (count == 0 && millis() - lastWriteMillis < flushMillis))
+      return;
+    if (!isOpen && !openFile())
+      return;
+    uint32_t startMicros = micros();
+    size_t written = file.write((const uint8_t *)sector, length);
+    file.flush();
+    lastWriteMicros = micros() - startMicros;
+    maxWriteMicros = max(maxWriteMicros, lastWriteMicros);
+    lastWriteMillis = millis();
+    if (written != length)
+    {
+      //keeps what was not written and reopens the file on the next attempt
+      writeErrors++;
+      file.close();
+      isOpen = false;
+      memmove(sector, sector + written, length - written);
+      length -= written;
+      return;
+    }
+    length = 0;
+  }
+
+  //one line for the dashboard: queued entries, dropped entries, card errors, write times
+  void drawStatus(int16_t x, int16_t y)
+  {
+    tft.fillRect(x, y, 300, 10, HX8357_BLACK);
+    tft.setCursor(x, y);
+    tft.setTextColor(dropped || writeErrors ? HX8357_RED : HX8357_GREEN);
+    tft.print("log q");
+    tft.print(count);
+    tft.print(" drop ");
+    tft.print(dropped);
+    tft.print(" err ");
+    tft.print(writeErrors);
+    tft.print(" write ");
+    tft.print(lastWriteMicros / 1000.0, 1);
+    tft.print("/");
+    tft.print(maxWriteMicros / 1000.0, 1);
+    tft.print("ms");
+  }
+};
+
+logService coordinatorLog;
+
+struct touchEvent
+{
+  int16_t x;
+  int16_t y;
+  uint32_t millis; //when the touch was recognised
+};
+
+//samples the touch screen from a timer interrupt so taps are seen while loop() waits for the
+//radio. a press has to last pressSamples samples and a release releaseSamples before the
+//next press counts, one event is queued per tap
+class touchInput
+{
+  public:
+  static const uint32_t sampleMicros = 10000;
+  static const uint8_t pressSamples = 3;
+  static const uint8_t releaseSamples = 5;
+  static const uint8_t queueSize = 8;
+  IntervalTimer timer;
+  volatile touchEvent queue[queueSize];
+  volatile uint8_t head = 0;
+  volatile uint8_t count = 0;
+  volatile uint32_t dropped = 0;
+  uint8_t pressedCount = 0;
+  uint8_t releasedCount = releaseSamples;
+  bool pressed = false;
+
+  void begin(void (*isr)())
   {
-    tft.println("error opening log file!");//turn a red led on instead
-    delay(10000);
+    timer.begin(isr, sampleMicros);
+  }
+
+  //runs in the timer interrupt, the touch pins and the adc are only used here
+  void sample()
+  {
+    TSPoint p = ts.getPoint();
+    if (p.z > MINPRESSURE && p.z < MAXPRESSURE)
+    {
+      releasedCount = 0;
+      if (pressed || ++pressedCount < pressSamples)
+        return;
+      pressed = true;
+      if (count == queueSize)
+      {
+        dropped++;
+        return;
+      }
+      volatile touchEvent &e = queue[(head + count) % queueSize];
+      e.x = map(p.x, TS_MINX, TS_MAXX, 0, tft.width());
+      e.y = map(p.y, TS_MINY, TS_MAXY, 0, tft.height());
+      e.millis = millis();
+      count++;
+    }
+    else
+    {
+      pressedCount = 0;
+      if (releasedCount < releaseSamples && ++releasedCount == releaseSamples)
+        pressed = false;
+    }
+  }
+
+  bool read(touchEvent &e)
+  {
+    noInterrupts();
+    bool available = count > 0;
+    if (available)
+    {
+      e.x = queue[head].x;
+      e.y = queue[head].y;
+      e.millis = queue[head].millis;
+      head = (head + 1) % queueSize;
+      count--;
+    }
+    interrupts();
+    return available;
   }
+};
+
+touchInput touch;
+
+void sampleTouch()
+{
+  touch.sample();
 }
 
-void logStringToFile(String &text){
-  File dataFile = SD.open(filename, FILE_WRITE);
-  // if the file is available, write to it:
-  if (dataFile)
+bool serviceTaps();
+
+//shows a message for up to ms, a tap away from the unit buttons dismisses it early. keeps the
+//log and the taps going meanwhile
+void uiDelay(uint32_t ms)
+{
+  uint32_t startMillis = millis();
+  while (millis() - startMillis < ms)
   {
-    dataFile.println(text);
-    dataFile.close();
+    updateSecondEdge();
+    coordinatorLog.service();
+    if (serviceTaps())
+      return;
   }
 }
 
@@ -135,6 +392,7 @@ void displayInfo()
     tft.print(gps.time.centisecond());
     setTime(gps.time.hour(), gps.time.minute(), gps.time.second(), gps.date.day(), gps.date.month(), gps.date.year());
     Teensy3Clock.set(now());
+    rtcEdge.restart();
   }
   else
   {
@@ -170,6 +428,38 @@ void digitalClockDisplay(uint32_t tt)
   //tft.println(Teensy3Clock.get());
 }
 
+traceWriter<File> xbeeTrace;
+
+//all radio traffic goes through sendFrame and readFrame so it can be traced
+void sendFrame(XBeeRequest &request)
+{
+  sendTraced(xbee, xbeeTrace, request, micros);
+}
+
+void readFrame()
+{
+  readTraced(xbee, xbeeTrace, micros);
+}
+
+//waits up to timeout for a frame as XBee::readPacket(timeout) does, taps are serviced meanwhile
+bool readFrame(int timeout)
+{
+  uint32_t startMillis = millis();
+  while ((int32_t)(millis() - startMillis) < timeout)
+  {
+    if (readTraced(xbee, xbeeTrace, micros))
+    {
+      return true;
+    }
+    if (xbee.getResponse().isError())
+    {
+      return false;
+    }
+    serviceTaps();
+  }
+  return false;
+}
+
 class nodes
 {
   public:
@@ -182,9 +472,19 @@ class nodes
   uint8_t dataPackage[4] = {0,0,0,0};
   uint8_t name;
   uint16_t color;
-  uint32_t p[3] = {0,0,0};
+  uint32_t p[numChannels] = {};
   uint32_t timeSetOnUnit = 0;
   uint16_t filenameTime = 0;
+  //health reported by the status polls
+  unitStatus status = {};
+  bool statusValid = false;
+  bool pollOutstanding = false;
+  uint8_t pollSequence = 0;
+  uint32_t pollSentMillis = 0;
+  uint32_t rttMillis = 0;
+  uint8_t rssi = 0;            //-dBm of the last reply
+  uint8_t linkQuality = 100;   //moving percentage of answered polls
+  int32_t clockOffsetMillis = 0;//unit minus coordinator
     
   nodes();
 
@@ -198,9 +498,10 @@ class nodes
           color = buttonColor;
           timeSetOnUnit = 0;
           filenameTime = 0;
-          p[0] = 0;
-          p[1] = 0;
-          p[2] = 0;
+          for (uint8_t c = 0; c < numChannels; c++)
+          {
+            p[c] = 0;
+          }
   }
   
   void addToPayload(uint32_t value){//adds a 32 bit value to the payload to be sent to the unit
@@ -217,20 +518,28 @@ class nodes
 
   uint32_t getCurrentTime(){//returns the unix time on the next second change
     uint32_t initialTime = Teensy3Clock.get();
-    while (Teensy3Clock.get() == initialTime); //wait until the clock changes to the next second
+    while (Teensy3Clock.get() == initialTime) //wait until the clock changes to the next second
+    {
+      serviceTaps();
+    }
     return Teensy3Clock.get();
   }
 
   bool checkTimeOnUnit(){//will check if the time set on this unit is within accepted delta of the coordinator
     bool timeSetCorrectly = false;
-    for (int i = 0; i<5; i++)//time,p[0],p[1],p[2],sdSuccess
+    for (int i = 0; i<numChannels+2; i++)//time,p[0]..p[numChannels-1],sdSuccess
     {  
-      if (xbee.readPacket(1000))
+      if (readFrame(1000))
       {
         Rx16Response resp;
         if (xbee.getResponse().getApiId() == RX_16_RESPONSE)
         {
           xbee.getResponse().getRx16Response(resp);
+          if (resp.getRemoteAddress16() != addr16 || resp.getDataLength() != sizeof(dataPackage))
+          {
+            i--;//a late status reply or a frame of another unit, not part of the handshake
+            continue;
+          }
           uint8_t frameData[] = {resp.getData(0),resp.getData(1),resp.getData(2),resp.getData(3)};
           uint32_t receivedTime = decodePayload(frameData);
           if(receivedTime>10000000)//then this must be the unix time
@@ -245,11 +554,11 @@ class nodes
             }
             timeSetOnUnit = receivedTime;
           }
-          else if(i<4) //must be pressure data
+          else if(i>0 && i<=numChannels) //must be pressure data
           {
             p[i-1] = receivedTime;
           }
-          else if(i==4)//reports the sdSuccessStatus
+          else if(i==numChannels+1)//reports the sdSuccessStatus
           {
             if(receivedTime != 1)// 0 or other values
             {
@@ -258,7 +567,7 @@ class nodes
               tft.println();
               tft.println("sd card initialization failed! sdSuccessStatus is false!");
               tft.println();
-              delay(2000);
+              uiDelay(2000);
             }
             else if (receivedTime == 1)
             {
@@ -275,11 +584,11 @@ class nodes
   void flushAPI()
   {
     //XBeeResponse discard;
-    xbee.readPacket();
+    readFrame();
     while(xbee.getResponse().isAvailable())
     {
       //Serial.println(xbee.getResponse().getApiId());
-      xbee.readPacket();
+      readFrame();
     }
   }
 
@@ -301,8 +610,8 @@ class nodes
       addToPayload(ttime);
       Tx16Request tx = Tx16Request(addr16, dataPackage, sizeof(dataPackage));
       uint32_t startOfTransmission = millis();
-      xbee.send(tx);
-      if (xbee.readPacket(1000))
+      sendFrame(tx);
+      if (readFrame(1000))
       {
         // got a response!
         // should be a znet tx status
@@ -327,7 +636,7 @@ class nodes
                 tft.println(timeSetOnUnit);
                 digitalClockDisplay(ttime);
                 color = HX8357_GREEN;
-                delay(10000);
+                uiDelay(10000);
               }
               else
               {
@@ -335,7 +644,7 @@ class nodes
                 tft.println("got the acknowledgement in time but the time is not set on the remote unit!");
                 tft.print("number of retries: ");
                 tft.println(numTries);
-                delay(5000);
+                uiDelay(5000);
                 color = HX8357_RED;
                 flushAPI();
               }
@@ -347,7 +656,7 @@ class nodes
               tft.println("Attemped to update the time but the response time was too long. will retry. get closer to the unit.");
               tft.print("number of attempts: ");
               tft.println(numTries);
-              delay(5000);
+              uiDelay(5000);
               color = HX8357_RED;
               flushAPI(); //the edge device doesn't know about the timing issue and will send the time and pressure data
             }
@@ -357,7 +666,7 @@ class nodes
             tft.println();
             tft.println("the remote unit did not receive our packet. is it powered on?");
             tft.println("If it is turned on, Try moving closer to the unit");
-            delay(5000);
+            uiDelay(5000);
             color = HX8357_RED;
             flushAPI();
           }
@@ -367,14 +676,14 @@ class nodes
       {
         tft.print("Error reading the ACK packet. Error Code:");
         tft.println(xbee.getResponse().getErrorCode());
-        delay(5000);
+        uiDelay(5000);
         color = HX8357_RED;
         flushAPI();
       }
       else
       {
         tft.println("local XBee did not provide a timely TX Status Response.  Radio is not configured properly or connected");
-        delay(5000);
+        uiDelay(5000);
         color = HX8357_RED;
         flushAPI();
       }
@@ -389,6 +698,138 @@ class nodes
     
   }
 
+  //sends a configuration frame (configGet or configSet or'ed with a parameter) and waits
+  //for the unit to answer it. returns 0 if the unit accepted it and 1 if it was rejected
+  //or not answered, value is replaced by the value the unit reports
+  uint8_t configure(uint8_t command, uint32_t &value)
+  {
+    uint8_t frame[configFrameLength];
+    encodeConfigFrame(frame, command, value);
+    Tx16Request tx = Tx16Request(addr16, frame, sizeof(frame));
+    flushAPI();
+    sendFrame(tx);
+    uint32_t startOfTransmission = millis();
+    while (millis() - startOfTransmission < 1000)
+    {
+      if (readFrame(100) && xbee.getResponse().getApiId() == RX_16_RESPONSE)
+      {
+        Rx16Response resp;
+        xbee.getResponse().getRx16Response(resp);
+        if (resp.getRemoteAddress16() == addr16 && resp.getDataLength() == configFrameLength &&
+            resp.getData(0) == configMarker && (resp.getData(1) & ~configRejected) == command)
+        {
+          value = decodeConfigValue(resp.getData());
+          return (resp.getData(1) & configRejected) ? 1 : 0;
+        }
+      }
+    }
+    return 1;
+  }
+
+  //asks the unit for the min, max and mean raw counts of every channel over its last
+  //complete second (rollupSecond) or minute (rollupMinute). returns 0 if all channels
+  //were received and 1 otherwise
+  uint8_t requestRollup(uint8_t scale, uint32_t &start, uint32_t &numReadings,
+                        uint16_t minimum[numChannels], uint16_t maximum[numChannels], uint16_t mean[numChannels])
+  {
+    for (uint8_t firstChannel = 0; firstChannel < numChannels; firstChannel += rollupChannelsPerReply)
+    {
+      uint8_t frame[rollupRequestLength] = {rollupMarker, scale, firstChannel};
+      Tx16Request tx = Tx16Request(addr16, frame, sizeof(frame));
+      flushAPI();
+      sendFrame(tx);
+      bool received = false;
+      uint32_t startOfTransmission = millis();
+      while (!received && millis() - startOfTransmission < 1000)
+      {
+        if (readFrame(100) && xbee.getResponse().getApiId() == RX_16_RESPONSE)
+        {
+          Rx16Response resp;
+          xbee.getResponse().getRx16Response(resp);
+          uint8_t *data = resp.getData();
+          if (resp.getRemoteAddress16() != addr16 || resp.getDataLength() < rollupHeaderLength ||
+              data[0] != rollupMarker || data[1] != scale || data[2] != firstChannel ||
+              resp.getDataLength() != rollupHeaderLength + 6 * data[3])
+          {
+            continue;
+          }
+          start = decodeUint32(data + 4);
+          numReadings = decodeUint32(data + 8);
+          data += rollupHeaderLength;
+          for (uint8_t c = firstChannel; c < firstChannel + resp.getData(3) && c < numChannels; c++)
+          {
+            minimum[c] = ((uint16_t)data[0] << 8) | data[1];
+            maximum[c] = ((uint16_t)data[2] << 8) | data[3];
+            mean[c] = ((uint16_t)data[4] << 8) | data[5];
+            data += 6;
+          }
+          received = true;
+        }
+      }
+      if (!received)
+      {
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  //asks the unit for its status without waiting for the answer
+  void sendStatusRequest()
+  {
+    if (pollOutstanding)//the previous poll was not answered
+    {
+      linkQuality -= (linkQuality + 7) / 8;
+    }
+    pollSequence++;
+    uint8_t frame[statusRequestLength] = {statusMarker, pollSequence};
+    //no tx status frame, it would double the traffic of every poll
+    Tx16Request tx = Tx16Request(addr16, ACK_OPTION, frame, sizeof(frame), NO_RESPONSE_FRAME_ID);
+    pollSentMillis = millis();
+    pollOutstanding = true;
+    sendFrame(tx);
+  }
+
+  void handleStatusReply(Rx16Response &resp)
+  {
+    unitStatus reply;
+    decodeStatusReply(resp.getData(), reply);
+    if (!pollOutstanding || reply.sequence != pollSequence)
+    {
+      return;//answer to an older poll
+    }
+    pollOutstanding = false;
+    rttMillis = millis() - pollSentMillis;
+    rssi = resp.getRssi();
+    linkQuality += (100 - linkQuality + 7) / 8;
+    //the reply was built half a round trip before it arrived
+    updateSecondEdge();
+    int64_t coordinatorTime = (int64_t)rtcEdge.second * 1000 + rtcEdge.since(micros()) / 1000 - rttMillis / 2;
+    int64_t unitTime = (int64_t)reply.unixTime * 1000 + reply.millisecond;
+    clockOffsetMillis = unitTime - coordinatorTime;
+    status = reply;
+    statusValid = true;
+    logEntry *e = coordinatorLog.add(logTelemetry, name);
+    if (e != nullptr)
+    {
+      e->parameter = rssi;
+      e->values[0] = status.recordsWritten;
+      e->values[1] = status.droppedReadings;
+      e->values[2] = status.sdFreeMiB;
+      e->values[3] = rttMillis;
+      e->values[4] = clockOffsetMillis;
+    }
+    if (status.flags & statusRecording)
+    {
+      color = HX8357_GREEN;
+    }
+    else if (color == HX8357_GREEN)
+    {
+      color = HX8357_CYAN;
+    }
+    drawButton();
+  }
+
   bool checkRecordingStatusOnUnit()
   {
     return true;
@@ -412,8 +853,8 @@ class nodes
       Tx16Request tx = Tx16Request(addr16, dataPackage, sizeof(dataPackage));
       flushAPI();
       uint32_t startOfTransmission = millis();
-      xbee.send(tx);
-      if (xbee.readPacket(1000))
+      sendFrame(tx);
+      if (readFrame(1000))
       {
         // got a response!
         // should be a znet tx status
@@ -433,14 +874,14 @@ class nodes
                 tft.print("round message duration = ");
                 tft.println(deltaT);
                 color = HX8357_CYAN;
-                delay(10000);
+                uiDelay(10000);
               }
               else
               {
                 tft.println("got the acknowledgement in time but the unit didn't acknowledge it!");
                 tft.print("number of retries: ");
                 tft.println(numTries);
-                delay(5000);
+                uiDelay(5000);
                 color = HX8357_RED;
               }
           }
@@ -449,7 +890,7 @@ class nodes
             tft.println("the remote unit did not receive our packet. is it powered on?");
             tft.println("If it is turned on, Try moving closer to the unit");
             tft.println();
-            delay(5000);
+            uiDelay(5000);
             color = HX8357_RED;
           }
         }
@@ -458,13 +899,13 @@ class nodes
       {
         tft.print("Error reading the ACK packet. Error Code:");
         tft.println(xbee.getResponse().getErrorCode());
-        delay(5000);
+        uiDelay(5000);
         color = HX8357_RED;
       }
       else
       {
         tft.println("local XBee did not provide a timely TX Status Response.  Radio is not configured properly or connected");
-        delay(5000);
+        uiDelay(5000);
         color = HX8357_RED;
       }
     }
@@ -477,6 +918,18 @@ class nodes
     }
   }
 
+  //feedback for a tap, shown before the command starts talking to the unit
+  void drawPressed()
+  {
+    int margin = 10;
+    tft.fillRoundRect(cornerX+margin, cornerY+margin,deltaX-margin,deltaY-margin,10,HX8357_YELLOW);
+    tft.setCursor(cornerX+deltaX/2-5,cornerY+margin+5);
+    tft.setTextColor(HX8357_BLACK);
+    tft.setTextSize(3);
+    tft.println(name);
+    tft.setTextSize(1);
+  }
+
   void drawButton()
   { 
     int margin = 10;
@@ -488,22 +941,56 @@ class nodes
     tft.setTextColor(HX8357_BLACK);
     tft.setTextSize(3);
     tft.println(name);
-    tft.setCursor(cornerX+margin+gap,cornerY+2* margin+height3);
     tft.setTextSize(1);
-    tft.print("P0 = ");
-    tft.print(convertToPressure(p[0]),2);
-    tft.print(" psi");
-    tft.setCursor(cornerX+margin+gap,cornerY+2 * margin+height3+height1);
-    tft.print("P1 = ");
-    tft.print(convertToPressure(p[1]),2);
-    tft.print(" psi");
-    tft.setCursor(cornerX+margin+gap,cornerY+2 * margin+height3+2 * height1);
-    tft.print("P2 = ");
-    tft.print(convertToPressure(p[2]),2);
-    tft.print(" psi");
+    //three rows per column, more channels are drawn in narrower columns
+    int numColumns = (numChannels + 2) / 3;
+    int columnWidth = (deltaX - margin - 2 * gap) / numColumns;
+    for (uint8_t c = 0; c < numChannels; c++)
+    {
+      tft.setCursor(cornerX+margin+gap+(c/3)*columnWidth,cornerY+2 * margin+height3+(c%3) * height1);
+      tft.print("P");
+      tft.print(c);
+      if (numColumns == 1)
+      {
+        tft.print(" = ");
+        tft.print(convertToPressure(p[c]),2);
+        tft.print(" psi");
+      }
+      else
+      {
+        tft.print(" ");
+        tft.print(convertToPressure(p[c]),1);
+      }
+    }
+    if (!statusValid)
+    {
+      tft.setCursor(cornerX+margin+gap,cornerY+2 * margin+height3+4 * height1);
+      tft.print(" ");
+      digitalClockDisplay(timeSetOnUnit);
+      return;
+    }
+    //rssi, round trip, answered polls, sd free space
+    tft.setCursor(cornerX+margin+gap,cornerY+2 * margin+height3+3 * height1);
+    tft.print("-");
+    tft.print(rssi);
+    tft.print("dBm ");
+    tft.print(rttMillis);
+    tft.print("ms ");
+    tft.print(linkQuality);
+    tft.print("% ");
+    tft.print(status.sdFreeMiB / 1024);
+    tft.print("G");
+    //clock offset, dropped readings, records in the current log
     tft.setCursor(cornerX+margin+gap,cornerY+2 * margin+height3+4 * height1);
-    tft.print(" ");
-    digitalClockDisplay(timeSetOnUnit);
+    if (clockOffsetMillis >= 0)
+      tft.print("+");
+    tft.print(clockOffsetMillis);
+    tft.print("ms d");
+    tft.print(status.droppedReadings);
+    tft.print(" n");
+    tft.print(status.recordsWritten);
+    if (!(status.flags & statusSdOk) || (status.flags & statusWriteError))
+      tft.print(" SD!");
   }
 
   float convertToPressure(uint32_t rawVal)
@@ -536,6 +1023,84 @@ nodes(7, 0x00E7, buttonWidth, 3 * buttonHeight, buttonWidth, buttonHeight, HX835
 //nodes(9, 0x00E9, buttonWidth, 4 * buttonHeight, buttonWidth, buttonHeight, HX8357_BLUE)
 };
 
+//taps on the unit buttons become commands that loop() runs one at a time. the touch queue is
+//also read while a command waits for the radio or shows a message, so a tap on another unit
+//is drawn as pressed at once and its command runs next. a tap on the unit whose command runs
+//or that is already queued would repeat the command and is dropped
+const uint8_t maxPendingTaps = 8;
+uint8_t pendingTaps[maxPendingTaps];//unit numbers in tap order
+uint8_t numPendingTaps = 0;
+int busyUnit = -1;//unit whose command is running
+
+int unitAt(int16_t x, int16_t y)
+{
+  for (int i = 0; i < numUnits; i++)
+  {
+    if (unit[i].cornerX < x && unit[i].cornerY < y && unit[i].cornerX + buttonWidth > x && unit[i].cornerY + buttonHeight > y)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+//reads the taps queued by the touch interrupt, returns true if one missed the unit buttons
+bool serviceTaps()
+{
+  bool missed = false;
+  touchEvent tap;
+  while (touch.read(tap))
+  {
+    int i = unitAt(tap.x, tap.y);
+    if (i < 0)
+    {
+      missed = true;
+      continue;
+    }
+    bool repeat = i == busyUnit;
+    for (uint8_t q = 0; q < numPendingTaps; q++)
+    {
+      repeat = repeat || pendingTaps[q] == i;
+    }
+    if (repeat || numPendingTaps == maxPendingTaps)
+    {
+      continue;
+    }
+    pendingTaps[numPendingTaps++] = i;
+    unit[i].drawPressed();
+  }
+  return missed;
+}
+
+//polls the units round robin and collects their answers, never waits for the radio
+void pollUnits()
+{
+  readFrame();
+  while (xbee.getResponse().isAvailable())
+  {
+    if (xbee.getResponse().getApiId() == RX_16_RESPONSE)
+    {
+      Rx16Response resp;
+      xbee.getResponse().getRx16Response(resp);
+      if (resp.getDataLength() == statusReplyLength && resp.getData(0) == statusMarker)
+      {
+        for (int i = 0; i < numUnits; i++)
+        {
+          if (unit[i].addr16 == resp.getRemoteAddress16())
+            unit[i].handleStatusReply(resp);
+        }
+      }
+    }
+    readFrame();
+  }
+  if (millis() - pollMillis >= pollIntervalMillis)
+  {
+    pollMillis = millis();
+    unit[pollIndex].sendStatusRequest();
+    pollIndex = (pollIndex + 1) % numUnits;
+  }
+}
+
 void drawUnits()
 {
   tft.fillScreen(HX8357_BLACK);
@@ -545,21 +1110,178 @@ void drawUnits()
   }
   tft.setTextColor(HX8357_GREEN);
   tft.setCursor(20, 420);
-  tft.print("Latitude = ");
-  tft.print(latitude,8);
+  fmtLine<48> position;
+  position.addText("Latitude = ").addFixed(llround(latitude * 1e8), 8);
+  tft.print(position.text());
   tft.setCursor(20, 440);
-  tft.print("Longitude = ");
-  tft.print(longitude,8);
+  position.length = 0;
+  position.addText("Longitude = ").addFixed(llround(longitude * 1e8), 8);
+  tft.print(position.text());
+  coordinatorLog.drawStatus(20, 460);
 }
 
 
+struct configParameterName
+{
+  const char *name;
+  uint8_t parameter;
+};
+
+const configParameterName configParameterNames[] =
+{
+  {"sample", paramSampleInterval},
+  {"output", paramOutputInterval},
+  {"decimation", paramDecimation},
+  {"channels", paramChannelMask},
+  {"threshold", paramTriggerThreshold},
+  {"resolution", paramAdcResolution},
+  {"debug", paramDebug},
+  {"trace", paramTrace},
+  {"quiet", paramQuietInterval},
+};
+
+//taps the radio frames of the coordinator into a .XBT file, out of line for tools/heapcheck.sh
+__attribute__((noinline)) void setTrace(bool on)
+{
+  if (on && !xbeeTrace.isOpen)
+  {
+    xbeeTrace.begin(SD, 0x0000, Teensy3Clock.get(), micros());
+  }
+  else if (!on)
+  {
+    xbeeTrace.end();
+  }
+  Serial.println(xbeeTrace.isOpen ? "trace on" : "trace off");
+}
+
+//prints the last complete second or minute rollup of a unit
+void printRollup(int unitNumber, char scale)
+{
+  uint32_t start = 0;
+  uint32_t numReadings = 0;
+  uint16_t minimum[numChannels];
+  uint16_t maximum[numChannels];
+  uint16_t mean[numChannels];
+  if (unit[unitNumber].requestRollup(scale == 'm' ? rollupMinute : rollupSecond, start, numReadings, minimum, maximum, mean))
+  {
+    Serial.println("no rollup received");
+    return;
+  }
+  Serial.print("unit ");
+  Serial.print(unitNumber);
+  Serial.print(scale == 'm' ? " minute " : " second ");
+  Serial.print(start);
+  Serial.print(", readings ");
+  Serial.println(numReadings);
+  for (uint8_t c = 0; c < numChannels; c++)
+  {
+    Serial.print("  P");
+    Serial.print(c);
+    Serial.print(" min ");
+    Serial.print(minimum[c]);
+    Serial.print(" max ");
+    Serial.print(maximum[c]);
+    Serial.print(" mean ");
+    Serial.println(mean[c]);
+  }
+}
+
+//a whole word in decimal
+bool parseNumber(const char *word, unsigned long &value)
+{
+  char *end;
+  value = strtoul(word, &end, 10);
+  return end != word && *end == 0;
+}
+
+//configures the edge units from the usb serial port without blocking the loop:
+//"set <unit> <parameter> <value>", "get <unit> <parameter>", "rollup <unit> s|m"
+//or "trace on|off" for the coordinator itself
+void serialCommand()
+{
+  static char line[64];
+  static uint8_t length = 0;
+  while (Serial.available() > 0)
+  {
+    char c = Serial.read();
+    if (c != '\n' && c != '\r')
+    {
+      if (length < sizeof(line) - 1)
+        line[length++] = c;
+      continue;
+    }
+    if (length == 0)
+      continue;
+    line[length] = 0;
+    length = 0;
+    if (strcmp(line, "trace on") == 0 || strcmp(line, "trace off") == 0)
+    {
+      setTrace(line[7] == 'n');
+      continue;
+    }
+    //split in place, sscanf reaches malloc inside the C library (see tools/heapcheck.cpp)
+    char *words[5] = {};
+    uint8_t numWords = 0;
+    for (char *word = strtok(line, " "); word != nullptr && numWords < 5; word = strtok(nullptr, " "))
+      words[numWords++] = word;
+    unsigned long rollupUnit = 0;
+    if (numWords == 3 && strcmp(words[0], "rollup") == 0 && parseNumber(words[1], rollupUnit) && rollupUnit < (unsigned long)numUnits &&
+        (strcmp(words[2], "s") == 0 || strcmp(words[2], "m") == 0))
+    {
+      printRollup(rollupUnit, words[2][0]);
+      continue;
+    }
+    const char *verb = numWords > 0 ? words[0] : "";
+    const char *name = numWords > 2 ? words[2] : "";
+    unsigned long unitNumber = numUnits;
+    unsigned long value = 0;
+    bool isSet = strcmp(verb, "set") == 0;
+    bool validNumbers = numWords > 1 && parseNumber(words[1], unitNumber) && (!isSet || (numWords > 3 && parseNumber(words[3], value)));
+    uint8_t parameter = 0;
+    for (const configParameterName &p : configParameterNames)
+    {
+      if (strcmp(name, p.name) == 0)
+        parameter = p.parameter;
+    }
+    if ((isSet ? numWords != 4 : (numWords != 3 || strcmp(verb, "get") != 0)) || !validNumbers || parameter == 0 ||
+        unitNumber >= (unsigned long)numUnits)
+    {
+      Serial.println("usage: set <unit> <parameter> <value> | get <unit> <parameter> | rollup <unit> s|m | trace on|off");
+      Serial.print("parameters:");
+      for (const configParameterName &p : configParameterNames)
+      {
+        Serial.print(" ");
+        Serial.print(p.name);
+      }
+      Serial.println();
+      continue;
+    }
+    uint32_t reported = value;
+    uint8_t unsuccessful = unit[unitNumber].configure((isSet ? configSet : configGet) | parameter, reported);
+    Serial.print("unit ");
+    Serial.print(unitNumber);
+    Serial.print(isSet ? " set " : " get ");
+    Serial.print(name);
+    Serial.print(unsuccessful ? " failed, value " : " , value ");
+    Serial.println(reported);
+    logEntry *e = coordinatorLog.add(logConfig, unitNumber);
+    if (e != nullptr)
+    {
+      e->result = unsuccessful;
+      e->parameter = parameter;
+      e->values[0] = reported;
+      e->values[1] = isSet;
+    }
+  }
+}
+
 void setup()
 {
   
   // set the Time library to use Teensy 3.0's RTC to keep time
   setSyncProvider(getTeensy3Time);
   setSyncInterval(10);
-  //Serial.begin(115200);
+  Serial.begin(115200);
   Serial1.begin(115200);
   Serial2.begin(GPSBaud);
   SD.begin(chipSelect);
@@ -593,8 +1315,23 @@ void setup()
   }
 
   time_t curt = Teensy3Clock.get();
-  sprintf(filename, "%02d%02d%02d%02d.CSV", day(curt), hour(curt), minute(curt), second(curt));
-  writeData();
+  //a directory per month, the same layout as the edge logs
+  fmtLine<sizeof(filename)> name;
+  name.addPadded(year(curt), 4).addPadded(month(curt), 2);
+  if (!SD.exists(name.text()))
+  {
+    SD.mkdir(name.text());
+  }
+  name.addChar('/').addPadded(day(curt), 2).addPadded(hour(curt), 2).addPadded(minute(curt), 2).addPadded(second(curt), 2);
+  strcpy(filename, name.addText(".CSV").text());
+  coordinatorLog.begin(filename);
+  logEntry *fix = coordinatorLog.add(logGpsFix, 0);
+  if (fix != nullptr)
+  {
+    fix->latitude = llround(latitude * 1e8);
+    fix->longitude = llround(longitude * 1e8);
+  }
+  coordinatorLog.service();
   delay(5000); //show the location data for 5 seconds
   
   if (timeStatus() != timeSet)
@@ -609,10 +1346,15 @@ void setup()
   }
 
   drawUnits();
+  touch.begin(sampleTouch);
 }
 
 void loop()
 {
+  updateSecondEdge();
+  serialCommand();
+  pollUnits();
+  coordinatorLog.service();
   time_t curTime = Teensy3Clock.get(); //current time
   if (curTime != initialTime){
     tft.setCursor(20,400);
@@ -620,65 +1362,40 @@ void loop()
     tft.setTextColor(HX8357_GREEN);
     digitalClockDisplay(curTime);
     initialTime = curTime;
+    coordinatorLog.drawStatus(20, 460);
   }
 
-  if(millis() - oldmillis > 2000){
-    oldmillis = millis();
-    // Retrieve a point
-    TSPoint p = ts.getPoint();
-    p.x = map(p.x, TS_MINX, TS_MAXX, 0, tft.width());
-    p.y = map(p.y, TS_MINY, TS_MAXY, 0, tft.height());
-    if (p.z > MINPRESSURE && p.z < MAXPRESSURE && p.x>0)
+  //one queued tap per pass, the units are polled and the log serviced between commands
+  serviceTaps();
+  if (numPendingTaps > 0)
+  {
+    int i = pendingTaps[0];
+    numPendingTaps--;
+    memmove(pendingTaps, pendingTaps + 1, numPendingTaps);
+    busyUnit = i;
+    if(unit[i].color != HX8357_GREEN) // It is not recording - it is either not initialized or we didn't get the response that it is recording
     {
-      for(int i = 0; i < numUnits ; i++)
+      uint8_t updateUnsuccessful = unit[i].updateTime();
+      logEntry *e = coordinatorLog.add(logUpdate, i);
+      if (e != nullptr)
       {
-        if(unit[i].cornerX<p.x && unit[i].cornerY<p.y && unit[i].cornerX+buttonWidth>p.x && unit[i].cornerY+buttonHeight>p.y)
-        {
-          if(unit[i].color != HX8357_GREEN) // It is not recording - it is either not initialized or we didn't get the response that it is recording
-          { 
-            String dataString = "At time ";
-            dataString += String(getTeensy3Time());
-            dataString += ".";
-            dataString += String(millis()%1000);
-            dataString += " , time on unit ";
-            dataString += String(i);
-            dataString += "  is asked to be updated. ";
-            uint8_t updateUnsuccessful = unit[i].updateTime();
-            if (updateUnsuccessful == 0){
-              dataString += " , update was successful. Pressures (0,1,2): ";
-              dataString += String(unit[i].p[0]);
-              dataString += " , ";
-              dataString += String(unit[i].p[1]);
-              dataString += " , ";
-              dataString += String(unit[i].p[2]);
-            }
-            else{
-              dataString += " , update was unsuccessful. ";
-            }
-            logStringToFile(dataString);
-          }
-          else //it is recording (it is green)
-          {
-            String dataString = "At time ";
-            dataString += String(getTeensy3Time());
-            dataString += ".";
-            dataString += String(millis()%1000);
-            dataString += " , recording on unit ";
-            dataString += String(i);
-            dataString += "  is asked to be stopped. ";
-            uint8_t stopUnsuccessful = unit[i].stopRecording();
-            if (stopUnsuccessful == 0){
-              dataString += " , stop command was successful. ";
-            }
-            else{
-              dataString += " , stop command was unsuccessful. ";
-            }
-            logStringToFile(dataString);
-          }
-          delay(500);
-        }
+        e->result = updateUnsuccessful;
+        for (uint8_t c = 0; c < numChannels; c++)
+          e->values[c] = unit[i].p[c];
       }
-      drawUnits();
-    } 
+    }
+    else //it is recording (it is green)
+    {
+      uint8_t stopUnsuccessful = unit[i].stopRecording();
+      logEntry *e = coordinatorLog.add(logStop, i);
+      if (e != nullptr)
+        e->result = stopUnsuccessful;
+    }
+    busyUnit = -1;
+    drawUnits();
+    for (uint8_t q = 0; q < numPendingTaps; q++)
+    {
+      unit[pendingTaps[q]].drawPressed();
+    }
   }
 }
@@ -3,27 +3,94 @@
 #include <Timelib.h>
 #include <SD.h>
 #include <SPI.h>
+#include <EEPROM.h>
+#include "protocol.h"
+#include "xbeetrace.h"
+#include "logindex.h"
+#include "fmt.h"
+#include "journal.h"
+#include "sampler.h"
+#include "rtcedge.h"
+#include "edgeunit.h"
 
 XBee xbee;
 uint8_t payload[] = {0, 1, 2, 3};
-char filename[13] = "ddhhmmss.csv";
+char filename[24] = "yyyymm/ddhhmmss.csv";
+const char activeJournalName[] = "ACTIVE.JNL"; //holds the name of the log that is open, removed on a clean close
+const char *const sidecarExtensions[] = {"SUM"}; //files written next to the log, recovered with it
 TxStatusResponse txStatus;
 const int chipSelect = BUILTIN_SDCARD;
 bool sdSuccessSwitch = true;
+bool cardInitialized = false;
 uint32_t recordingMillis = millis();
 uint32_t averagingMillis = millis();
 uint32_t previousHourMillis = millis();
 bool writeSwitch = false;
 bool sendPressureSwitch = false;
-uint32_t p0 = 0;
-uint32_t p1 = 0;
-uint32_t p2 = 0;
-int numReadings = 0;
 int previousHour = 0;
 bool debug = false;
 uint32_t offset = 0;
-unsigned long previousWriteTime = 0;
-long Millis = 0;
+secondEdge rtcEdge;//anchors micros() to the rtc
+uint64_t previousRecordMicros = 0;//capture time of the last record, microseconds since 1970
+uint32_t recordsWritten = 0;//in the current log
+uint32_t droppedReadings = 0;
+bool writeError = false;//a record failed to write since the last status poll
+uint64_t sdFreeBytes = 0;//measured once at boot, counting the free clusters is too slow for every poll
+
+//one channel per pressure transducer, add pins here for valves with more transducers
+sampler<A0, A1, A2> pressure;
+const uint8_t numChannels = decltype(pressure)::numChannels;
+static_assert(numChannels == numPressureChannels, "the pin map of the sampler and numPressureChannels in protocol.h differ");
+decltype(pressure) quietBatch;//batches combined into one record while the signal is static
+
+//min, max and mean of every channel over one second or one minute, built from the
+//batches of the sampler so the readings are only touched once
+class rollup
+{
+  public:
+  uint32_t start = 0;//unix time of the period
+  uint32_t numReadings = 0;
+  uint64_t sum[numChannels] = {};
+  uint16_t minimum[numChannels] = {};
+  uint16_t maximum[numChannels] = {};
+
+  void reset(uint32_t periodStart)
+  {
+    start = periodStart;
+    numReadings = 0;
+  }
+
+  template <class batchT>
+  void add(const batchT &batch)
+  {
+    if (batch.numReadings == 0)
+    {
+      return;
+    }
+    for (uint8_t c = 0; c < numChannels; c++)
+    {
+      sum[c] = numReadings == 0 ? batch.sum[c] : sum[c] + batch.sum[c];
+      minimum[c] = numReadings == 0 || batch.minimum[c] < minimum[c] ? batch.minimum[c] : minimum[c];
+      maximum[c] = numReadings == 0 || batch.maximum[c] > maximum[c] ? batch.maximum[c] : maximum[c];
+    }
+    numReadings += batch.numReadings;
+  }
+
+  uint16_t mean(uint8_t c) const
+  {
+    return numReadings > 0 ? sum[c] / numReadings : 0;
+  }
+};
+
+rollup secondRollup;
+rollup minuteRollup;
+rollup lastSecondRollup;//the last complete periods, reported over the radio
+rollup lastMinuteRollup;
+
+const int configAddress = 0;
+edgeConfig config = defaultEdgeConfig;
+edgeConfig pendingConfig = config;
+bool configPending = false;
 
 float convertToPressure(uint32_t rawVal)
 {
@@ -35,14 +102,16 @@ float convertToPressure(uint32_t rawVal)
   return pressure;
 }
 
-void serialPrintPressure()
+void serialPrintPressure(const uint32_t mean[numChannels])
 {
   if(debug){
-    Serial.print(convertToPressure(p0 / numReadings));
-    Serial.print(" , ");
-    Serial.print(convertToPressure(p1 / numReadings));
-    Serial.print(" , ");
-    Serial.println(convertToPressure(p2 / numReadings));
+    for (uint8_t c = 0; c < numChannels; c++)
+    {
+      if (c > 0)
+        Serial.print(" , ");
+      Serial.print(convertToPressure(mean[c]));
+    }
+    Serial.println();
   }
 }
 
@@ -62,65 +131,448 @@ uint32_t decodePayload(uint8_t data[4])
          ((uint32_t)(data[3]));
 }
 
+typedef journal<File, SDClass> sdJournal;
+sdJournal logJournal(SD, millis, activeJournalName);
+sdJournal summaryJournal(SD, millis, nullptr);//per second and per minute rollups, ddhhmmss.SUM
+
+//recovers the log that was open when the power was cut and its sidecar files
+void recoverJournal()
+{
+  File active = SD.open(activeJournalName, FILE_READ);
+  if (!active)
+  {
+    return;
+  }
+  char name[24] = {0};
+  active.read(name, sizeof(name) - 1);
+  active.close();
+  uint64_t truncated = 0;
+  uint64_t logLength = sdJournal::recoverFile(SD, name, &truncated);
+  if (debug)
+  {
+    Serial.print("recovered ");
+    Serial.print(name);
+    Serial.print(", truncated bytes: ");
+    Serial.println((unsigned long)truncated);
+  }
+  char *extension = strchr(name, '.');
+  if (extension != nullptr)
+  {
+    for (const char *sidecar : sidecarExtensions)
+    {
+      strcpy(extension + 1, sidecar);
+      sdJournal::recoverFile(SD, name);
+    }
+    strcpy(extension + 1, "IDX");
+    sdJournal::recoverIndex(SD, name, logLength);
+  }
+  SD.remove(activeJournalName);
+}
+
+//writes "S,start,readings,min,max,mean,..." (or M for a minute) for the logged channels
+void writeRollupLine(char scale, const rollup &r)
+{
+  fmtLine<40 + 18 * numChannels> line;
+  line.addChar(scale).addChar(',').addUnsigned(r.start).addChar(',').addUnsigned(r.numReadings);
+  for (uint8_t c = 0; c < numChannels; c++)
+  {
+    if (config.channelMask & (1u << c))
+    {
+      line.addChar(',').addUnsigned(r.minimum[c]).addChar(',').addUnsigned(r.maximum[c]).addChar(',').addUnsigned(r.mean(c));
+    }
+  }
+  line.addChar('\n');
+  summaryJournal.append(line.data, line.length);
+}
+
+//closes the current second and, when it is the last of its minute, the minute
+void closeSecondRollup(bool closeMinute)
+{
+  if (secondRollup.numReadings > 0)
+  {
+    writeRollupLine('S', secondRollup);
+    lastSecondRollup = secondRollup;
+    uint32_t minute = secondRollup.start - secondRollup.start % 60;
+    if (minuteRollup.numReadings > 0 && minuteRollup.start != minute)
+    {
+      writeRollupLine('M', minuteRollup);
+      lastMinuteRollup = minuteRollup;
+      minuteRollup.reset(minute);
+    }
+    if (minuteRollup.numReadings == 0)
+    {
+      minuteRollup.reset(minute);
+    }
+    minuteRollup.add(secondRollup);
+    secondRollup.reset(0);
+  }
+  if (closeMinute && minuteRollup.numReadings > 0)
+  {
+    writeRollupLine('M', minuteRollup);
+    lastMinuteRollup = minuteRollup;
+    minuteRollup.reset(0);
+  }
+}
+
+//adds a batch to the rollup of the second it was captured in
+void updateRollups(const decltype(pressure) &batch, uint64_t captureTime)
+{
+  if (batch.numReadings == 0)
+  {
+    return;
+  }
+  uint32_t second = captureTime / 1000000;
+  if (secondRollup.numReadings > 0 && secondRollup.start != second)
+  {
+    closeSecondRollup(false);
+  }
+  if (secondRollup.numReadings == 0)
+  {
+    secondRollup.reset(second);
+  }
+  secondRollup.add(batch);
+}
+traceWriter<File> xbeeTrace;
+
+//all radio traffic goes through sendFrame and readFrame so it can be traced
+void sendFrame(XBeeRequest &request)
+{
+  sendTraced(xbee, xbeeTrace, request, micros);
+}
+
+void readFrame()
+{
+  readTraced(xbee, xbeeTrace, micros);
+}
+
+//opens or closes the trace file to follow config.trace. kept out of line, tools/heapcheck.sh
+//allows it by name: opening a file allocates in the SD library
+__attribute__((noinline)) void updateTrace()
+{
+  if (config.trace && cardInitialized && !xbeeTrace.isOpen)
+  {
+    xbeeTrace.begin(SD, 0xFFFF, Teensy3Clock.get(), micros());
+  }
+  else if (!config.trace)
+  {
+    xbeeTrace.end();
+  }
+}
+
+//echoes the configuration in the log, tag is 'H' for the header of a new log and 'C' for a change
+void writeConfigLine(char tag)
+{
+  fmtLine<96> line;
+  line.addChar('#').addChar(tag).addChar(',').addUnsigned(Teensy3Clock.get());
+  line.addChar(',').addUnsigned(config.sampleIntervalMillis).addChar(',').addUnsigned(config.outputIntervalMillis);
+  line.addChar(',').addUnsigned(config.decimation).addChar(',').addUnsigned(config.adcResolution);
+  line.addChar(',').addHex(config.channelMask).addChar(',').addUnsigned(config.triggerThreshold);
+  line.addChar(',').addUnsigned(config.quietIntervalMillis).addChar('\n');
+  logJournal.append(line.data, line.length);
+}
+
+void applyConfig()
+{
+  debug = config.debug;
+  analogReadResolution(config.adcResolution);
+  analogReadAveraging(config.decimation);
+  updateTrace();
+}
+
+void loadConfig()
+{
+  edgeConfig stored;
+  EEPROM.get(configAddress, stored);
+  if (stored.magic == configMagic)
+  {
+    config = stored;
+  }
+  pendingConfig = config;
+  applyConfig();
+}
+
+//called between records so a record never mixes two configurations
+void commitPendingConfig()
+{
+  if (!configPending)
+  {
+    return;
+  }
+  config = pendingConfig;
+  configPending = false;
+  applyConfig();
+  EEPROM.put(configAddress, config);
+  if (writeSwitch)
+  {
+    writeConfigLine('C');
+  }
+}
+
+//answers a configuration frame from the coordinator. a set is staged and takes
+//effect after the current record, gets report the staged value
+void handleConfigFrame(uint8_t frame[configFrameLength])
+{
+  uint8_t reply[configFrameLength];
+  if (answerConfigFrame(frame, pendingConfig, writeSwitch, reply))
+  {
+    configPending = true;
+    if (!writeSwitch)
+    {
+      commitPendingConfig();
+    }
+  }
+  Tx16Request tx(0x0000, reply, sizeof(reply));
+  sendFrame(tx);
+}
+
+//answers a status poll of the coordinator
+void handleStatusRequest(uint8_t sequence)
+{
+  uint8_t flags = (writeSwitch ? statusRecording : 0) | (sdSuccessSwitch ? statusSdOk : 0) | (writeError ? statusWriteError : 0);
+  uint8_t reply[statusReplyLength];
+  answerStatusRequest(sequence, flags, recordsWritten, sdFreeBytes, logJournal.bytesWritten + summaryJournal.bytesWritten,
+                      droppedReadings, rtcEdge, micros(), reply);
+  writeError = false;
+  //no tx status frame is requested, the coordinator measures the round trip itself
+  Tx16Request tx(0x0000, ACK_OPTION, reply, sizeof(reply), NO_RESPONSE_FRAME_ID);
+  sendFrame(tx);
+}
+
 time_t getTeensy3Time()
 {
   return Teensy3Clock.get();
 }
 
-void writeData()
-{
-  // make a string for assembling the data to log:
-  //long val = long(millis() % 1000) - long(offset);
-  String dataString = "";
-  dataString += String(previousWriteTime);
-  dataString += ".";
-  if(Millis<100){
-    dataString += "0";
-  }
-  dataString += String(Millis);//val >= 0 ? val : val + 1000);
-  dataString += " , ";
-  dataString += String(p0/numReadings);
-  dataString += " , ";
-  dataString += String(p1/numReadings);
-  dataString += " , ";
-  dataString += String(p2/numReadings);
-  Millis += 50;
-  if (debug){
-    // Serial.print(offset);
-    // Serial.print(" - ");
-    // Serial.print(val);
-    // Serial.print(" - ");
-    // Serial.println(1000+val);
-  }
-  // dataString += " , ";
-  // dataString += String(millis()%1000);
-
-  File dataFile = SD.open(filename, FILE_WRITE);
-  // if the file is available, write to it:
-  if (dataFile)
-  {
-    dataFile.println(dataString);
-    dataFile.close();
+//polled from loop() and before every reading, see rtcedge.h
+void updateSecondEdge()
+{
+  rtcEdge.update(Teensy3Clock.get(), micros());
+}
+
+//converts a micros() stamp of the current or the previous second to microseconds since 1970
+uint64_t rtcMicros(uint32_t stamp)
+{
+  return (uint64_t)rtcEdge.second * 1000000 + (int32_t)(stamp - rtcEdge.edgeMicros);
+}
+
+void writeData(const decltype(pressure) &batch)
+{
+  if (batch.numReadings == 0)
+  {
+    return;//no readings, there is nothing to average
+  }
+  // assemble the record to log:
+  uint32_t mean[numChannels];
+  batch.average(mean);
+  uint64_t captureTime = rtcMicros(batch.captureMicros());
+  //every block starts with an anchor line "#T,seconds,microseconds" and the first field of
+  //a record is the microseconds since the previous record, blocks stay readable on their own
+  fmtLine<48 + 14 * numChannels> record;
+  logJournal.reserve(sizeof(record.data));
+  if (!logJournal.anchored)
+  {
+    record.addText("#T,").addUnsigned(captureTime / 1000000).addChar(',').addPadded(captureTime % 1000000, 6).addChar('\n');
+    previousRecordMicros = captureTime;
+    logJournal.anchored = true;
+    logJournal.anchorSeconds = captureTime / 1000000;
+    logJournal.anchorMicros = captureTime % 1000000;
+  }
+  record.addUnsigned(captureTime - previousRecordMicros);
+  previousRecordMicros = captureTime;
+  for (uint8_t c = 0; c < numChannels; c++)
+  {
+    if (config.channelMask & (1u << c))
+    {
+      record.addText(" , ").addUnsigned(mean[c]);
+    }
+  }
+  record.addChar('\n');
+
+  if (logJournal.append(record.data, record.length))
+  {
+    recordsWritten++;
     if (debug){
-      serialPrintPressure();
+      serialPrintPressure(mean);
     }
   }
   else
   {
+    writeError = true;
     if(debug){
-      Serial.print("error opening the log file: ");//turn a red led on instead
+      Serial.print("error writing the log file: ");//turn a red led on instead
       Serial.println(filename);
     }
-    delay(10000);
   }
 }
 
+//activity detector: records are written every outputIntervalMillis while the pressure
+//moves and every quietIntervalMillis while it is static. a change of triggerThreshold raw
+//counts between two batches on any logged channel switches to the fast rate, the rate
+//drops again after quietHoldMillis without a change of more than half the threshold
+const uint32_t quietHoldMillis = 10000;
+bool activeRate = true;
+uint32_t lastActivityMillis = 0;
+uint32_t quietRecordMillis = 0;
+uint32_t previousMean[numChannels];
+bool havePreviousMean = false;
+
+//tags a rate change in the log with the new interval between records
+void writeRateLine(uint16_t intervalMillis)
+{
+  fmtLine<24> line;
+  line.addText("#R,").addUnsigned(intervalMillis).addChar('\n');
+  logJournal.append(line.data, line.length);
+}
+
+void resetActivity()
+{
+  activeRate = true;
+  lastActivityMillis = millis();
+  havePreviousMean = false;
+  quietBatch.reset();
+}
+
+void writeQuietBatch();
+
+//called every outputIntervalMillis with the batch of that interval
+void recordBatch()
+{
+  if (pressure.numReadings == 0)
+  {
+    return;//an empty batch would read as zero pressure and as a change
+  }
+  updateRollups(pressure, rtcMicros(pressure.captureMicros()));
+  uint32_t mean[numChannels];
+  pressure.average(mean);
+  uint32_t change = 0;
+  for (uint8_t c = 0; c < numChannels; c++)
+  {
+    uint32_t delta = mean[c] > previousMean[c] ? mean[c] - previousMean[c] : previousMean[c] - mean[c];
+    if (havePreviousMean && (config.channelMask & (1u << c)) && delta > change)
+    {
+      change = delta;
+    }
+    previousMean[c] = mean[c];
+  }
+  havePreviousMean = true;
+  if (config.triggerThreshold == 0 || change >= config.triggerThreshold || (activeRate && 2 * change > config.triggerThreshold))
+  {
+    lastActivityMillis = millis();
+  }
+
+  bool active = millis() - lastActivityMillis < quietHoldMillis;
+  if (active && !activeRate)
+  {
+    if (quietBatch.numReadings > 0)//the static part before the event keeps its own record
+    {
+      writeData(quietBatch);
+      quietBatch.reset();
+    }
+    writeRateLine(config.outputIntervalMillis);
+  }
+  else if (!active && activeRate)
+  {
+    writeRateLine(config.quietIntervalMillis);
+    quietRecordMillis = millis();
+  }
+  activeRate = active;
+
+  if (activeRate)
+  {
+    writeData(pressure);
+    return;
+  }
+  quietBatch.add(pressure);
+  if (millis() - quietRecordMillis >= config.quietIntervalMillis)
+  {
+    writeQuietBatch();
+  }
+}
+
+//writes the readings collected at the quiet rate so far and starts a new quiet interval
+void writeQuietBatch()
+{
+  quietRecordMillis = millis();
+  if (quietBatch.numReadings > 0)
+  {
+    writeData(quietBatch);
+    quietBatch.reset();
+  }
+}
+
+//opens the log named by filename and its sidecar files, out of line for tools/heapcheck.sh
+__attribute__((noinline)) bool openLogFiles()
+{
+  if (!logJournal.open(filename))
+  {
+    return false;
+  }
+  recordsWritten = 0;
+  //the first record of the log is built from readings of this session only
+  resetActivity();
+  pressure.reset();
+  recordingMillis = millis();
+  averagingMillis = millis();
+  commitPendingConfig();
+  writeConfigLine('H');
+  char sidecarName[24];
+  strcpy(sidecarName, filename);
+  char *extension = strchr(sidecarName, '.') + 1;
+  strcpy(extension, "IDX");
+  logJournal.openIndex(sidecarName, Teensy3Clock.get(), config.channelMask);
+  strcpy(extension, "SUM");
+  secondRollup.reset(0);
+  minuteRollup.reset(0);
+  if (summaryJournal.open(sidecarName))
+  {
+    fmtLine<32> line;
+    line.addText("#H,").addUnsigned(Teensy3Clock.get()).addChar(',').addHex(config.channelMask).addChar('\n');
+    summaryJournal.append(line.data, line.length);
+  }
+  return true;
+}
+
+void closeLogFiles()
+{
+  writeQuietBatch();
+  closeSecondRollup(true);
+  summaryJournal.close();
+  logJournal.close();
+}
+
+//answers a rollup request with the last complete second or minute
+void handleRollupRequest(uint8_t scale, uint8_t firstChannel)
+{
+  const rollup &r = scale == rollupMinute ? lastMinuteRollup : lastSecondRollup;
+  uint8_t count = firstChannel < numChannels ? numChannels - firstChannel : 0;
+  count = count > rollupChannelsPerReply ? rollupChannelsPerReply : count;
+  uint8_t reply[rollupHeaderLength + 6 * rollupChannelsPerReply];
+  reply[0] = rollupMarker;
+  reply[1] = scale;
+  reply[2] = firstChannel;
+  reply[3] = count;
+  encodeUint32(reply + 4, r.start);
+  encodeUint32(reply + 8, r.numReadings);
+  uint8_t *data = reply + rollupHeaderLength;
+  for (uint8_t c = firstChannel; c < firstChannel + count; c++)
+  {
+    uint16_t values[3] = {r.minimum[c], r.maximum[c], r.mean(c)};
+    for (uint16_t value : values)
+    {
+      *data++ = value >> 8;
+      *data++ = value & 0xFF;
+    }
+  }
+  Tx16Request tx(0x0000, reply, data - reply);
+  sendFrame(tx);
+}
+
 int sendData(u_int32_t t)
 {
   uint16_t coordinatorAddress = 0x0000;
   addToPayload(t);
   Tx16Request tx(coordinatorAddress, payload, sizeof(payload));
-  xbee.send(tx);
+  sendFrame(tx);
 
   return 0;
 }
@@ -128,13 +580,13 @@ int sendData(u_int32_t t)
 void flushAPI()
 {
   //XBeeResponse discard;
-  xbee.readPacket();
+  readFrame();
   while(xbee.getResponse().isAvailable())
   {
     if(debug){
       Serial.println(xbee.getResponse().getApiId());
     }
-    xbee.readPacket();
+    readFrame();
     //xbee.getResponse(discard);
   }
 
@@ -149,30 +601,22 @@ void sendSetTimeAndPressure()
 {
   time_t t = Teensy3Clock.get();
   sendData(t);
-  p0 = 0;
-  p1 = 0;
-  p2 = 0;
+  pressure.reset();
   for (int i = 0; i<20;i++)
   {
-    p0 += analogRead(A0);
-    delay(1);
-    p1 += analogRead(A1);
-    delay(1);
-    p2 += analogRead(A2);
-    delay(1);
+    pressure.read();
+    delay(numChannels);
   }
-  p0 /= 20;
-  p1 /= 20;
-  p2 /= 20;
-  delay(100);
-  sendData(p0);
-  delay(100);
-  flushAPI();
-  sendData(p1);
-  delay(100);
-  flushAPI();
-  sendData(p2);
+  uint32_t mean[numChannels];
+  pressure.average(mean);
   delay(100);
+  for (uint8_t c = 0; c < numChannels; c++)//one packet per channel, in pin map order
+  {
+    if (c > 0)
+      flushAPI();
+    sendData(mean[c]);
+    delay(100);
+  }
   flushAPI();
   if (sdSuccessSwitch)
   {
@@ -183,12 +627,13 @@ void sendSetTimeAndPressure()
     sendData(0);
   }
   
-  p0 = 0;
-  p1 = 0;
-  p2 = 0;
+  pressure.reset();
 
   delay(100);
   flushAPI();
+  averagingMillis = millis();//the handshake is not counted as dropped readings
+  recordingMillis = millis();//the first record waits for a full interval of readings
+  resetActivity();
 }
 
 void setup()
@@ -198,16 +643,14 @@ void setup()
   //   ;
   setSyncProvider(getTeensy3Time);
   setSyncInterval(10);
+  loadConfig();
   if(debug){
     Serial.begin(115200);
     delay(50);
   }
   Serial1.begin(115200);
   delay(50);
-  analogReadResolution(12);
-  pinMode(A0, INPUT);
-  pinMode(A1, INPUT);
-  pinMode(A2, INPUT);
+  pressure.begin();
   xbee.setSerial(Serial1);
   delay(5000);
   if(debug){
@@ -224,9 +667,13 @@ void setup()
   else
   {
     sdSuccessSwitch = true;
+    cardInitialized = true;
     if(debug){
     Serial.println("card initialized.");
     }
+    recoverJournal();//repairs the tail of the log that was open if the power was cut
+    sdFreeBytes = SD.totalSize() - SD.usedSize();
+    updateTrace();
   }
   
   flushAPI();
@@ -234,7 +681,8 @@ void setup()
 
 void loop()
 {
-  xbee.readPacket();
+  updateSecondEdge();
+  readFrame();
   if (xbee.getResponse().isAvailable())
   {
     Rx16Response resp;
@@ -242,6 +690,21 @@ void loop()
     if (xbee.getResponse().getApiId() == RX_16_RESPONSE)
     {
       xbee.getResponse().getRx16Response(resp);
+      if (resp.getDataLength() == configFrameLength && resp.getData(0) == configMarker)
+      {
+        handleConfigFrame(resp.getData());
+        return;
+      }
+      if (resp.getDataLength() == statusRequestLength && resp.getData(0) == statusMarker)
+      {
+        handleStatusRequest(resp.getData(1));
+        return;
+      }
+      if (resp.getDataLength() == rollupRequestLength && resp.getData(0) == rollupMarker)
+      {
+        handleRollupRequest(resp.getData(1), resp.getData(2));
+        return;
+      }
       uint8_t frameData[] = {resp.getData(0),resp.getData(1),resp.getData(2),resp.getData(3)};
       uint32_t receivedTime = decodePayload(frameData);
       if(debug){
@@ -251,14 +714,35 @@ void loop()
       {
         Teensy3Clock.set(receivedTime);
         setTime(receivedTime);
+        rtcEdge.restart();
+        updateSecondEdge();
         if(debug){
           Serial.println(receivedTime);
         } 
         previousHour = hour(receivedTime);
-        sprintf(filename, "%02d%02d%02d%02d.CSV", day(receivedTime), hour(receivedTime), minute(receivedTime), second(receivedTime));
+        //the unit did not sample while stopped, the idle time is not dropped readings
+        averagingMillis = millis();
+        //a directory per month, the file names only hold day and time
+        fmtLine<sizeof(filename)> name;
+        name.addPadded(year(receivedTime), 4).addPadded(month(receivedTime), 2);
+        if (cardInitialized && !SD.exists(name.text()))
+        {
+          SD.mkdir(name.text());
+        }
+        name.addChar('/').addPadded(day(receivedTime), 2).addPadded(hour(receivedTime), 2);
+        name.addPadded(minute(receivedTime), 2).addPadded(second(receivedTime), 2).addText(".CSV");
+        strcpy(filename, name.text());
         if(debug){
           Serial.println(filename);
         }
+        sdSuccessSwitch = cardInitialized && openLogFiles();//reported to the coordinator in sendSetTimeAndPressure
+        if (cardInitialized && !sdSuccessSwitch)
+        {
+          if(debug){
+            Serial.print("error opening the log file: ");
+            Serial.println(filename);
+          }
+        }
         writeSwitch = true;
         sendPressureSwitch = true;
         flushAPI();
@@ -266,33 +750,30 @@ void loop()
       else if (receivedTime == 0)
       {
         writeSwitch = false;
+        closeLogFiles();
         flushAPI();
       }
     } 
   }
-  bool nextSecond = Teensy3Clock.get() != previousWriteTime;
-  if ((millis() - recordingMillis >= 50) && writeSwitch && sdSuccessSwitch)
+  if ((millis() - recordingMillis >= config.outputIntervalMillis) && writeSwitch && sdSuccessSwitch)
   {
     recordingMillis = millis();
-    if(nextSecond){
-      //offset = millis() % 1000;
-      previousWriteTime = Teensy3Clock.get();
-      Millis = 0;
+    recordBatch();
+    //Serial.println(pressure.numReadings);
+    pressure.reset();//initialize after writing to file
+    if (configPending)
+    {
+      //a quiet record must not mix readings from both sides of the change
+      writeQuietBatch();
     }
-    writeData();
-    //Serial.println(numReadings);
-    numReadings = 0;//initialize after writing to file
-    p0 = 0;//initialize after writing to file
-    p1 = 0;//initialize after writing to file
-    p2 = 0;//initialize after writing to file
+    commitPendingConfig();
   }
-  if (writeSwitch && millis()-averagingMillis >= 2)//averaging the readings
+  if (writeSwitch && millis()-averagingMillis >= config.sampleIntervalMillis)//averaging the readings
   {
+    droppedReadings += (millis() - averagingMillis) / config.sampleIntervalMillis - 1;
     averagingMillis = millis();
-    p0 += analogRead(A0);
-    p1 += analogRead(A1);
-    p2 += analogRead(A2);
-    numReadings++;
+    updateSecondEdge();
+    pressure.read();
   }
   if (sendPressureSwitch)//everytime time is received, send the set time and pressures
   {
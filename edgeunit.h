@@ -0,0 +1,145 @@
+#ifndef EDGEUNIT_H
+#define EDGEUNIT_H
+
+#include <stdint.h>
+
+#include "protocol.h"
+#include "rtcedge.h"
+
+// The radio answers of the edge that do not touch the hardware: its runtime
+// configuration and the replies to configuration frames and status polls.
+// edge.cpp sends the replies built here, tools/swarmsim.cpp models a unit with
+// the same functions so the simulation follows the firmware.
+
+//runtime settings of the unit, changed over the radio and kept in EEPROM
+struct edgeConfig
+{
+  uint32_t magic;
+  uint16_t sampleIntervalMillis;
+  uint16_t outputIntervalMillis;
+  uint8_t decimation;
+  uint8_t adcResolution;
+  uint8_t debug;
+  uint32_t channelMask;
+  uint32_t triggerThreshold;
+  uint8_t trace;
+  uint16_t quietIntervalMillis;
+};
+
+static const uint32_t configMagic = 0x45434633; //changes whenever edgeConfig changes
+static const edgeConfig defaultEdgeConfig = {configMagic, 2, 50, 1, 12, 0, (1u << numPressureChannels) - 1, 0, 0, 1000};
+
+inline uint32_t getConfigValue(const edgeConfig &c, uint8_t parameter)
+{
+  switch (parameter)
+  {
+    case paramSampleInterval: return c.sampleIntervalMillis;
+    case paramOutputInterval: return c.outputIntervalMillis;
+    case paramDecimation: return c.decimation;
+    case paramChannelMask: return c.channelMask;
+    case paramTriggerThreshold: return c.triggerThreshold;
+    case paramAdcResolution: return c.adcResolution;
+    case paramDebug: return c.debug;
+    case paramTrace: return c.trace;
+    case paramQuietInterval: return c.quietIntervalMillis;
+  }
+  return 0;
+}
+
+//returns false if the value is out of range for the parameter
+inline bool setConfigValue(edgeConfig &c, uint8_t parameter, uint32_t value)
+{
+  switch (parameter)
+  {
+    case paramSampleInterval:
+      if (value < 1 || value > c.outputIntervalMillis)
+        return false;
+      c.sampleIntervalMillis = value;
+      return true;
+    case paramOutputInterval:
+      if (value < c.sampleIntervalMillis || value > c.quietIntervalMillis)
+        return false;
+      c.outputIntervalMillis = value;
+      return true;
+    case paramDecimation:
+      if (value != 1 && value != 4 && value != 8 && value != 16 && value != 32)
+        return false;
+      c.decimation = value;
+      return true;
+    case paramChannelMask:
+      if (value == 0 || value >= (1u << numPressureChannels))
+        return false;
+      c.channelMask = value;
+      return true;
+    case paramTriggerThreshold:
+      c.triggerThreshold = value;
+      return true;
+    case paramAdcResolution:
+      if (value < 8 || value > 16)
+        return false;
+      c.adcResolution = value;
+      return true;
+    case paramDebug:
+      if (value > 1)
+        return false;
+      c.debug = value;
+      return true;
+    case paramTrace:
+      if (value > 1)
+        return false;
+      c.trace = value;
+      return true;
+    case paramQuietInterval:
+      if (value < c.outputIntervalMillis || value > 60000)
+        return false;
+      c.quietIntervalMillis = value;
+      return true;
+  }
+  return false;
+}
+
+//builds the reply to a configuration frame. a set is staged in pending, gets report
+//the staged value. returns true if pending changed. the channel mask is refused while
+//recording: the columns of a log, its index header and its rollups follow the mask of
+//the "#H" line, the host tools could not tell which channel a column holds after a change
+inline bool answerConfigFrame(const uint8_t frame[configFrameLength], edgeConfig &pending, bool recording, uint8_t reply[configFrameLength])
+{
+  uint8_t command = frame[1];
+  uint8_t parameter = command & configParameterMask;
+  bool changed = false;
+  if (command & configSet)
+  {
+    edgeConfig c = pending;
+    uint32_t value = decodeConfigValue(frame);
+    bool fixed = recording && parameter == paramChannelMask && value != pending.channelMask;
+    if (!fixed && setConfigValue(c, parameter, value))
+    {
+      pending = c;
+      changed = true;
+    }
+    else
+    {
+      command |= configRejected;
+    }
+  }
+  encodeConfigFrame(reply, command, getConfigValue(pending, parameter));
+  return changed;
+}
+
+//builds the reply to a status poll. the free space is the free space measured at boot
+//less the bytes written since, the time is taken from the rtc second edge
+inline void answerStatusRequest(uint8_t sequence, uint8_t flags, uint32_t recordsWritten, uint64_t sdFreeBytes, uint64_t bytesWritten,
+                                uint32_t droppedReadings, const secondEdge &edge, uint32_t nowMicros, uint8_t reply[statusReplyLength])
+{
+  unitStatus status;
+  status.sequence = sequence;
+  status.flags = flags;
+  status.recordsWritten = recordsWritten;
+  status.sdFreeMiB = (sdFreeBytes > bytesWritten ? sdFreeBytes - bytesWritten : 0) >> 20;
+  status.droppedReadings = droppedReadings;
+  status.unixTime = edge.second;
+  status.millisecond = edge.since(nowMicros) / 1000;
+  encodeStatusReply(reply, status);
+}
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef FMT_H
+#define FMT_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Allocation free formatting for the log lines and file names of the firmware,
+// used in place of String and the printf family on the paths loop() runs. The
+// fmt functions write into the caller's buffer without a terminator and return
+// the number of characters written. Also built on the host by tools/fmtbench.cpp.
+
+static const char fmtDigitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+//writes v in decimal, zero padded to width digits
+static inline uint8_t fmtPadded(char *out, uint32_t v, uint8_t width)
+{
+  char digits[10];
+  uint8_t n = 10;
+  while (v >= 100)
+  {
+    uint32_t pair = (v % 100) * 2;
+    v /= 100;
+    digits[--n] = fmtDigitPairs[pair + 1];
+    digits[--n] = fmtDigitPairs[pair];
+  }
+  if (v >= 10)
+  {
+    digits[--n] = fmtDigitPairs[v * 2 + 1];
+    digits[--n] = fmtDigitPairs[v * 2];
+  }
+  else
+  {
+    digits[--n] = '0' + v;
+  }
+  uint8_t length = 10 - n;
+  uint8_t padding = width > length ? width - length : 0;
+  memset(out, '0', padding);
+  memcpy(out + padding, digits + n, length);
+  return padding + length;
+}
+
+static inline uint8_t fmtUnsigned(char *out, uint32_t v)
+{
+  return fmtPadded(out, v, 1);
+}
+
+static inline uint8_t fmtSigned(char *out, int32_t v)
+{
+  if (v < 0)
+  {
+    *out = '-';
+    return 1 + fmtUnsigned(out + 1, -(uint32_t)v);
+  }
+  return fmtUnsigned(out, v);
+}
+
+//upper case hex, zero padded to width digits
+static inline uint8_t fmtHex(char *out, uint32_t v, uint8_t width)
+{
+  uint8_t length = 1;
+  while (length < 8 && (v >> (4 * length)) != 0)
+    length++;
+  if (width > length)
+    length = width;
+  for (uint8_t i = length; i > 0; i--, v >>= 4)
+    out[i - 1] = "0123456789ABCDEF"[v & 15];
+  return length;
+}
+
+//writes value / 10^decimals with all the decimals, e.g. degrees kept in 1e-8 units
+static inline uint8_t fmtFixed(char *out, int64_t value, uint8_t decimals)
+{
+  uint8_t n = 0;
+  uint64_t magnitude = value;
+  if (value < 0)
+  {
+    out[n++] = '-';
+    magnitude = -(uint64_t)value;
+  }
+  uint32_t scale = 1;
+  for (uint8_t i = 0; i < decimals; i++)
+    scale *= 10;
+  n += fmtUnsigned(out + n, magnitude / scale);
+  if (decimals > 0)
+  {
+    out[n++] = '.';
+    n += fmtPadded(out + n, magnitude % scale, decimals);
+  }
+  return n;
+}
+
+//a line assembled on the stack. every add checks the room left, a field that does not fit
+//is dropped and overflow is set, text() terminates the line
+template <uint16_t Capacity>
+class fmtLine
+{
+  public:
+  char data[Capacity];
+  uint16_t length = 0;
+  bool overflow = false;
+
+  fmtLine &addChar(char c)
+  {
+    if (room(1))
+      data[length++] = c;
+    return *this;
+  }
+
+  fmtLine &addText(const char *s)
+  {
+    uint16_t n = strlen(s);
+    if (room(n))
+    {
+      memcpy(data + length, s, n);
+      length += n;
+    }
+    return *this;
+  }
+
+  fmtLine &addUnsigned(uint32_t v) { return addPadded(v, 1); }
+
+  fmtLine &addPadded(uint32_t v, uint8_t width)
+  {
+    if (room(width > 10 ? width : 10))
+      length += fmtPadded(data + length, v, width);
+    return *this;
+  }
+
+  fmtLine &addSigned(int32_t v)
+  {
+    if (room(11))
+      length += fmtSigned(data + length, v);
+    return *this;
+  }
+
+  fmtLine &addHex(uint32_t v, uint8_t width = 1)
+  {
+    if (room(8))
+      length += fmtHex(data + length, v, width);
+    return *this;
+  }
+
+  fmtLine &addFixed(int64_t value, uint8_t decimals)
+  {
+    if (room(21))
+      length += fmtFixed(data + length, value, decimals);
+    return *this;
+  }
+
+  const char *text()
+  {
+    data[length] = 0;
+    return data;
+  }
+
+  private:
+  //keeps one byte for the terminator of text()
+  bool room(uint16_t n)
+  {
+    if (length + n < Capacity)
+      return true;
+    overflow = true;
+    return false;
+  }
+};
+
+#endif
@@ -0,0 +1,307 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fmt.h"
+#include "logindex.h"
+
+// Append only log of the edge. Records are collected in a block, every block is
+// followed by a trailer line "#B,sequence,length,crc32" so the file stays a
+// readable csv and a torn tail can be detected after a power cut. The file is
+// kept open and its directory entry is only synced every few blocks or every
+// syncMillis.
+//
+// Blocks are not sector aligned: the trailers vary in length, so a commit
+// usually ends part way into a sector and the next one rewrites that sector.
+// Recovery does not depend on the alignment, it keeps the longest run of blocks
+// whose crc checks.
+//
+// Templated on the file system so tools/journaltest.cpp can cut the writes of an
+// in-memory card. FsT has open(name, mode) with the FILE_READ and FILE_WRITE
+// modes of SD.h and remove(name), FileT has the read, write, seek, size,
+// truncate, flush and close of the SD library's File.
+
+static inline uint32_t crc32(uint32_t crc, const uint8_t *data, size_t length)
+{
+  //nibble table crc32 (0xEDB88320), small enough to keep in flash
+  static const uint32_t table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++)
+  {
+    crc = table[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+    crc = table[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+template <class FileT, class FsT>
+class journal
+{
+  public:
+  static const uint16_t blockSize = 480; //payload per block, the trailer follows it
+  static const uint8_t blocksPerSync = 8;
+  static const uint32_t syncMillis = 1000; //bounds the data lost on a power cut
+  FsT &fs;
+  uint32_t (*clock)(); //millis() on the unit
+  FileT file;
+  char block[blockSize];
+  uint16_t length = 0;
+  uint32_t sequence = 0;
+  uint8_t blocksSinceSync = 0;
+  uint32_t lastSyncMillis = 0;
+  uint64_t bytesWritten = 0;//since boot, for the free space estimate
+  bool isOpen = false;
+  bool anchored = false;//the block holds a time anchor line, cleared for every new block
+  uint32_t anchorSeconds = 0;//time of the anchor line, written to the index with the block
+  uint32_t anchorMicros = 0;
+  uint64_t fileOffset = 0;
+  FileT index;
+  bool indexed = false;
+  const char *activeName;//file that holds the name of the open log, nullptr for the sidecar files
+
+  journal(FsT &fsName, uint32_t (*clockName)(), const char *activeFileName) : fs(fsName), clock(clockName), activeName(activeFileName)
+  {
+  }
+
+  bool open(const char *name)
+  {
+    close();
+    file = fs.open(name, FILE_WRITE);
+    if (!file)
+    {
+      return false;
+    }
+    FileT active = activeName != nullptr ? fs.open(activeName, FILE_WRITE) : FileT();
+    if (active)
+    {
+      active.truncate(0);
+      active.write((const uint8_t *)name, strlen(name));
+      active.close();
+    }
+    length = 0;
+    sequence = 0;
+    anchored = false;
+    fileOffset = file.size();
+    blocksSinceSync = 0;
+    lastSyncMillis = clock();
+    isOpen = true;
+    return true;
+  }
+
+  //starts a sparse time index of the anchored blocks, see logindex.h
+  bool openIndex(const char *name, uint32_t startTime, uint32_t channelMask)
+  {
+    index = fs.open(name, FILE_WRITE);
+    if (!index)
+    {
+      return false;
+    }
+    if (index.size() == 0)
+    {
+      logIndexHeader header = {logIndexMagic, logIndexVersion, 0, sizeof(logIndexEntry), startTime, channelMask};
+      index.write((const uint8_t *)&header, sizeof(header));
+    }
+    indexed = true;
+    return true;
+  }
+
+  //returns false if the record could not be written to the card
+  bool append(const char *record, uint16_t recordLength)
+  {
+    if (!isOpen)
+    {
+      return false;
+    }
+    bool success = true;
+    if (length + recordLength > blockSize)
+    {
+      success = commit();
+    }
+    memcpy(block + length, record, recordLength);
+    length += recordLength;
+    if (clock() - lastSyncMillis >= syncMillis)
+    {
+      success = commit() && success;
+      sync();
+    }
+    return success;
+  }
+
+  //commits the block if recordLength bytes do not fit, so the next append starts no new block
+  bool reserve(uint16_t recordLength)
+  {
+    if (length + recordLength > blockSize)
+    {
+      return commit();
+    }
+    return true;
+  }
+
+  //writes the pending records followed by their trailer
+  bool commit()
+  {
+    if (length == 0)
+    {
+      return true;
+    }
+    fmtLine<40> trailer;
+    trailer.addText("#B,").addUnsigned(sequence).addChar(',').addUnsigned(length).addChar(',');
+    trailer.addHex(crc32(0, (const uint8_t *)block, length), 8).addChar('\n');
+    uint16_t trailerLength = trailer.length;
+    bool success = file.write((const uint8_t *)block, length) == length;
+    success = success && file.write((const uint8_t *)trailer.data, trailerLength) == trailerLength;
+    if (indexed && anchored)
+    {
+      logIndexEntry entry = {anchorSeconds, anchorMicros, fileOffset};
+      index.write((const uint8_t *)&entry, sizeof(entry));
+      bytesWritten += sizeof(entry);
+    }
+    fileOffset += length + trailerLength;
+    bytesWritten += length + trailerLength;
+    sequence++;
+    length = 0;
+    anchored = false;
+    if (++blocksSinceSync >= blocksPerSync)
+    {
+      sync();
+    }
+    return success;
+  }
+
+  void sync()
+  {
+    file.flush();
+    if (indexed)
+    {
+      index.flush();
+    }
+    blocksSinceSync = 0;
+    lastSyncMillis = clock();
+  }
+
+  void close()
+  {
+    if (!isOpen)
+    {
+      return;
+    }
+    commit();
+    file.close();
+    if (indexed)
+    {
+      index.close();
+      indexed = false;
+    }
+    if (activeName != nullptr)
+    {
+      fs.remove(activeName);
+    }
+    isOpen = false;
+  }
+
+  //checks if the text at position in f is a trailer line of a block with a valid crc,
+  //returns the position after the trailer or 0
+  static uint64_t validBlockEnd(FileT &f, uint64_t position)
+  {
+    char trailer[32];
+    f.seek(position);
+    int n = f.read(trailer, sizeof(trailer) - 1);
+    if (n <= 0)
+    {
+      return 0;
+    }
+    trailer[n] = 0;
+    char *newline = strchr(trailer, '\n');
+    unsigned long seq;
+    unsigned int blockLength;
+    unsigned long crc;
+    if (newline == nullptr || sscanf(trailer, "#B,%lu,%u,%lx", &seq, &blockLength, &crc) != 3 ||
+        blockLength == 0 || blockLength > blockSize || blockLength > position)
+    {
+      return 0;
+    }
+    uint8_t data[blockSize];
+    f.seek(position - blockLength);
+    if (f.read(data, blockLength) != (int)blockLength || crc32(0, data, blockLength) != crc)
+    {
+      return 0;
+    }
+    return position + (newline - trailer) + 1;
+  }
+
+  //finds the last valid block of a log and truncates everything after it. scans
+  //backwards from the end so a large log only costs a few sector reads. returns the
+  //length of the repaired log, the number of bytes cut goes to truncated
+  static uint64_t recoverFile(FsT &fs, const char *name, uint64_t *truncated = nullptr)
+  {
+    FileT f = fs.open(name, FILE_WRITE);
+    if (!f)
+    {
+      return 0;
+    }
+    uint64_t end = 0;
+    uint64_t fileSize = f.size();
+    char chunk[64];
+    uint64_t chunkEnd = fileSize;
+    while (end == 0 && chunkEnd > 0)
+    {
+      uint64_t chunkStart = chunkEnd > sizeof(chunk) ? chunkEnd - sizeof(chunk) : 0;
+      f.seek(chunkStart);
+      int n = f.read(chunk, chunkEnd - chunkStart);
+      for (int i = n - 1; i >= 0 && end == 0; i--)
+      {
+        //a trailer starts with '#' at the beginning of a line
+        if (chunk[i] == '#' && (i > 0 ? chunk[i - 1] == '\n' : chunkStart == 0))
+        {
+          end = validBlockEnd(f, chunkStart + i);
+        }
+      }
+      //restart one byte further so a trailer split across chunks is checked once more
+      chunkEnd = chunkStart > 0 ? chunkStart + 1 : 0;
+    }
+    if (end < fileSize)
+    {
+      f.truncate(end);
+    }
+    if (truncated != nullptr)
+    {
+      *truncated = fileSize - end;
+    }
+    f.close();
+    return end;
+  }
+
+  //drops a torn index entry and the entries of blocks that were cut from the log
+  static void recoverIndex(FsT &fs, const char *name, uint64_t logLength)
+  {
+    FileT f = fs.open(name, FILE_WRITE);
+    if (!f)
+    {
+      return;
+    }
+    uint64_t numEntries = f.size() >= sizeof(logIndexHeader) ? (f.size() - sizeof(logIndexHeader)) / sizeof(logIndexEntry) : 0;
+    logIndexEntry entry;
+    while (numEntries > 0)
+    {
+      f.seek(sizeof(logIndexHeader) + (numEntries - 1) * sizeof(logIndexEntry));
+      if (f.read(&entry, sizeof(entry)) == sizeof(entry) && entry.offset < logLength)
+      {
+        break;
+      }
+      numEntries--;
+    }
+    uint64_t length = f.size() >= sizeof(logIndexHeader) ? sizeof(logIndexHeader) + numEntries * sizeof(logIndexEntry) : 0;
+    if (length < f.size())
+    {
+      f.truncate(length);
+    }
+    f.close();
+  }
+};
+
+#endif
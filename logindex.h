@@ -0,0 +1,39 @@
+#ifndef LOGINDEX_H
+#define LOGINDEX_H
+
+#include <stdint.h>
+
+// Sparse time index written by the edge next to every log as ddhhmmss.IDX.
+// A logIndexHeader is followed by one logIndexEntry per journal block of the
+// log: the time of the block's "#T" anchor line and the byte offset where the
+// block starts. Entries are in time order, so a time range is found with a
+// binary search and the log is parsed from that offset only. Little endian,
+// as written by the Teensy and read by tools/logquery.cpp.
+//
+// Logs are kept in a directory per month, YYYYMM/ddhhmmss.CSV, and the full
+// start time is in the index header and in the "#H" line of the log.
+
+static const uint32_t logIndexMagic = 0x58444958; //"XIDX"
+static const uint8_t logIndexVersion = 1;
+
+struct logIndexHeader
+{
+  uint32_t magic;
+  uint8_t version;
+  uint8_t reserved;
+  uint16_t entrySize;
+  uint32_t startTime;   //unix time the log was opened
+  uint32_t channelMask; //channels logged when the log was opened
+};
+
+struct logIndexEntry
+{
+  uint32_t seconds; //anchor time of the block
+  uint32_t micros;
+  uint64_t offset;  //of the block in the log
+};
+
+static_assert(sizeof(logIndexHeader) == 16, "index header layout");
+static_assert(sizeof(logIndexEntry) == 16, "index entry layout");
+
+#endif
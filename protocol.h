@@ -0,0 +1,123 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+
+// Frames exchanged between the coordinator and the edge units.
+// A 4 byte frame carries one 32 bit value (msb first): the unix time to start
+// recording, 0 to stop, and the handshake replies of the edge.
+// A configuration frame is 6 bytes: configMarker, command, 32 bit value (msb first).
+// The edge answers every configuration frame with the same command and the
+// value it holds, the configRejected bit is set if a set was refused.
+
+//pressure transducers per edge unit, the handshake sends one value per channel after
+//the time. edge.cpp checks its sampler pin map against this
+static const uint8_t numPressureChannels = 3;
+
+static const uint8_t configFrameLength = 6;
+static const uint8_t configMarker = 0xC0;
+
+static const uint8_t configGet = 0x00;      //or'ed with a parameter
+static const uint8_t configSet = 0x80;      //or'ed with a parameter
+static const uint8_t configRejected = 0x40; //set in the reply
+static const uint8_t configParameterMask = 0x3F;
+
+enum configParameter : uint8_t
+{
+  paramSampleInterval = 1,  //milliseconds between adc readings
+  paramOutputInterval = 2,  //milliseconds between records
+  paramDecimation = 3,      //conversions averaged by the adc for every reading
+  paramChannelMask = 4,     //bit c set logs channel c, refused while recording
+  paramTriggerThreshold = 5,//raw adc counts between records that switch to the output interval, 0 always uses it
+  paramAdcResolution = 6,   //bits
+  paramDebug = 7,           //0 or 1
+  paramTrace = 8,           //0 or 1, taps the radio frames into a .XBT file
+  paramQuietInterval = 9,   //milliseconds between records while the signal is static
+  numConfigParameters
+};
+
+// A status request is 2 bytes: statusMarker, sequence. The edge answers with a
+// statusReplyLength byte frame, multi byte fields are msb first.
+static const uint8_t statusMarker = 0xC1;
+static const uint8_t statusRequestLength = 2;
+static const uint8_t statusReplyLength = 21;
+
+static const uint8_t statusRecording = 0x01;  //flags
+static const uint8_t statusSdOk = 0x02;
+static const uint8_t statusWriteError = 0x04; //a record failed to write since the last poll
+
+struct unitStatus
+{
+  uint8_t sequence;
+  uint8_t flags;
+  uint32_t recordsWritten;  //in the current log
+  uint32_t sdFreeMiB;
+  uint32_t droppedReadings; //adc readings missed since boot
+  uint32_t unixTime;        //rtc of the unit when the reply was built
+  uint16_t millisecond;     //milliseconds since the rtc second edge
+};
+
+// A rollup request is 3 bytes: rollupMarker, rollupSecond or rollupMinute and the first
+// channel wanted. The reply repeats these 3 bytes followed by the number of channels in
+// it, the start of the period (unix time), the number of readings and then min, max and
+// mean of each channel as 16 bit raw counts. The last complete period is reported.
+static const uint8_t rollupMarker = 0xC2;
+static const uint8_t rollupRequestLength = 3;
+static const uint8_t rollupSecond = 'S';
+static const uint8_t rollupMinute = 'M';
+static const uint8_t rollupHeaderLength = 12;
+static const uint8_t rollupChannelsPerReply = 8;
+
+inline void encodeUint32(uint8_t *data, uint32_t value)
+{
+  data[0] = (uint8_t)((value & 0xFF000000) >> 24);
+  data[1] = (uint8_t)((value & 0x00FF0000) >> 16);
+  data[2] = (uint8_t)((value & 0x0000FF00) >> 8);
+  data[3] = (uint8_t)(value & 0x000000FF);
+}
+
+inline uint32_t decodeUint32(const uint8_t *data)
+{
+  return ((uint32_t)(data[0])<<24)+
+         ((uint32_t)(data[1])<<16)+
+         ((uint32_t)(data[2])<<8)+
+         ((uint32_t)(data[3]));
+}
+
+inline void encodeStatusReply(uint8_t frame[statusReplyLength], const unitStatus &status)
+{
+  frame[0] = statusMarker;
+  frame[1] = status.sequence;
+  frame[2] = status.flags;
+  encodeUint32(frame + 3, status.recordsWritten);
+  encodeUint32(frame + 7, status.sdFreeMiB);
+  encodeUint32(frame + 11, status.droppedReadings);
+  encodeUint32(frame + 15, status.unixTime);
+  frame[19] = (uint8_t)(status.millisecond >> 8);
+  frame[20] = (uint8_t)(status.millisecond & 0xFF);
+}
+
+inline void decodeStatusReply(const uint8_t frame[statusReplyLength], unitStatus &status)
+{
+  status.sequence = frame[1];
+  status.flags = frame[2];
+  status.recordsWritten = decodeUint32(frame + 3);
+  status.sdFreeMiB = decodeUint32(frame + 7);
+  status.droppedReadings = decodeUint32(frame + 11);
+  status.unixTime = decodeUint32(frame + 15);
+  status.millisecond = ((uint16_t)frame[19] << 8) | frame[20];
+}
+
+inline void encodeConfigFrame(uint8_t frame[configFrameLength], uint8_t command, uint32_t value)
+{
+  frame[0] = configMarker;
+  frame[1] = command;
+  encodeUint32(frame + 2, value);
+}
+
+inline uint32_t decodeConfigValue(const uint8_t frame[configFrameLength])
+{
+  return decodeUint32(frame + 2);
+}
+
+#endif
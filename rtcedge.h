@@ -0,0 +1,67 @@
+#ifndef RTCEDGE_H
+#define RTCEDGE_H
+
+#include <stdint.h>
+
+// Sub second time from an rtc that only counts seconds: the micros() of every
+// second edge is kept and times are measured from it. The edge is polled, so it
+// is seen late by however long the sketch was busy, a block commit or a sync on
+// the edge, a blocking radio command on the coordinator. So the edge is
+// predicted one second after the previous one and only pulled towards the
+// polled edge: one seen early proves the prediction late and replaces it, a
+// small lag moves it by a quarter to follow the drift of the crystals and a
+// larger lag is a stall and ignored. Used by edge.cpp and coordinator.cpp.
+
+class secondEdge
+{
+  public:
+  static const uint32_t maxLagMicros = 2000;//an edge seen later than this after its prediction was delayed by a stall
+  static const uint32_t maxGap = 10;//seconds between polls before the edge is taken anew
+  uint32_t second = 0;//rtc time of the last edge
+  uint32_t edgeMicros = 0;//micros() at the last edge, filtered
+
+  void update(uint32_t rtcNow, uint32_t now)
+  {
+    if (rtcNow == second)
+    {
+      return;
+    }
+    uint32_t elapsed = rtcNow - second;
+    second = rtcNow;
+    if (elapsed > maxGap)
+    {
+      //first edge since boot or since the clock was set, nothing to predict from
+      edgeMicros = now;
+      return;
+    }
+    uint32_t predicted = edgeMicros + elapsed * 1000000;
+    int32_t lag = now - predicted;
+    if (lag < 0)
+    {
+      edgeMicros = now;
+    }
+    else if (lag < (int32_t)maxLagMicros)
+    {
+      edgeMicros = predicted + lag / 4;
+    }
+    else
+    {
+      edgeMicros = predicted;
+    }
+  }
+
+  //the clock was set, the edges of the old time predict nothing
+  void restart()
+  {
+    second = 0;
+  }
+
+  //microseconds since the edge, clamped to the second so a late poll never reads as the next one
+  uint32_t since(uint32_t now) const
+  {
+    uint32_t t = now - edgeMicros;
+    return t < 1000000 ? t : 999999;
+  }
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdint.h>
+
+// Accumulates the readings of the pressure transducers of the edge between
+// records. Uses analogRead(), micros() and pinMode() of the Arduino core, which
+// the includer declares first: edge.cpp through Arduino.h, tools/samplerbench.cpp
+// through stubs.
+
+//the channel count and pin map are template parameters so the per channel
+//loops have a fixed trip count and the accumulators are contiguous arrays
+template <uint8_t... Pins>
+class sampler
+{
+  public:
+  static constexpr uint8_t numChannels = sizeof...(Pins);
+  static constexpr uint8_t pins[numChannels] = {Pins...};
+  uint32_t sum[numChannels] = {};
+  uint32_t numReadings = 0;
+  uint16_t minimum[numChannels];
+  uint16_t maximum[numChannels];
+  uint32_t firstMicros = 0;//micros() of the first and last reading since the reset
+  uint32_t lastMicros = 0;
+
+  sampler()
+  {
+    reset();
+  }
+
+  void begin()
+  {
+    for (uint8_t c = 0; c < numChannels; c++)
+    {
+      pinMode(pins[c], INPUT);
+    }
+  }
+
+  void read()
+  {
+    lastMicros = micros();
+    if (numReadings == 0)
+    {
+      firstMicros = lastMicros;
+    }
+    for (uint8_t c = 0; c < numChannels; c++)
+    {
+      uint16_t reading = analogRead(pins[c]);
+      sum[c] += reading;
+      minimum[c] = reading < minimum[c] ? reading : minimum[c];
+      maximum[c] = reading > maximum[c] ? reading : maximum[c];
+    }
+    numReadings++;
+  }
+
+  //adds the readings of another batch, used to combine batches into one record
+  void add(const sampler &other)
+  {
+    if (other.numReadings == 0)
+    {
+      return;
+    }
+    if (numReadings == 0)
+    {
+      firstMicros = other.firstMicros;
+    }
+    lastMicros = other.lastMicros;
+    for (uint8_t c = 0; c < numChannels; c++)
+    {
+      sum[c] += other.sum[c];
+      minimum[c] = other.minimum[c] < minimum[c] ? other.minimum[c] : minimum[c];
+      maximum[c] = other.maximum[c] > maximum[c] ? other.maximum[c] : maximum[c];
+    }
+    numReadings += other.numReadings;
+  }
+
+  //micros() at the middle of the readings, the time the averaged values represent
+  uint32_t captureMicros() const
+  {
+    if (numReadings == 0)
+    {
+      return micros();
+    }
+    return firstMicros + (lastMicros - firstMicros) / 2;
+  }
+
+  //writes the averaged raw readings of all channels to mean
+  void average(uint32_t mean[numChannels]) const
+  {
+    uint32_t n = numReadings > 0 ? numReadings : 1;
+    for (uint8_t c = 0; c < numChannels; c++)
+    {
+      mean[c] = sum[c] / n;
+    }
+  }
+
+  void reset()
+  {
+    for (uint8_t c = 0; c < numChannels; c++)
+    {
+      sum[c] = 0;
+      minimum[c] = 0xFFFF;
+      maximum[c] = 0;
+    }
+    numReadings = 0;
+  }
+};
+
+template <uint8_t... Pins>
+constexpr uint8_t sampler<Pins...>::pins[];
+
+#endif
@@ -0,0 +1,322 @@
+#ifndef EDGELOG_H
+#define EDGELOG_H
+
+// Host side reader for the logs of an edge unit: the journaled .CSV logs and
+// their sparse .IDX time indexes (see logindex.h). Logs are mapped read only
+// and parsed in place, a query only touches the blocks the index points at.
+// Also holds the time parsing and statistics the host tools share.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <filesystem>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "logindex.h"
+
+class mappedFile
+{
+  public:
+  const char *data = nullptr;
+  size_t size = 0;
+
+  mappedFile() = default;
+  mappedFile(const mappedFile &) = delete;
+  mappedFile &operator=(const mappedFile &) = delete;
+  mappedFile(mappedFile &&other) noexcept { *this = std::move(other); }
+  mappedFile &operator=(mappedFile &&other) noexcept
+  {
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+    return *this;
+  }
+  ~mappedFile() { close(); }
+
+  bool open(const std::string &path)
+  {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+      ::close(fd);
+      return false;
+    }
+    size = st.st_size;
+    if (size > 0)
+    {
+      void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED)
+      {
+        ::close(fd);
+        size = 0;
+        return false;
+      }
+      madvise(p, size, MADV_SEQUENTIAL);
+      data = (const char *)p;
+    }
+    ::close(fd);
+    return true;
+  }
+
+  void close()
+  {
+    if (data != nullptr)
+      munmap((void *)data, size);
+    data = nullptr;
+    size = 0;
+  }
+};
+
+static const int maxLogChannels = 32;
+
+struct edgeRecord
+{
+  uint64_t micros; //unix time of the capture in microseconds
+  uint8_t numValues;
+  uint32_t values[maxLogChannels];
+};
+
+static inline const char *parseUnsigned(const char *p, const char *end, uint64_t &value)
+{
+  value = 0;
+  while (p < end && *p >= '0' && *p <= '9')
+    value = value * 10 + (*p++ - '0');
+  return p;
+}
+
+//calls f(const edgeRecord &) for every record of log[begin, end) captured before
+//stopMicros, returns false when f asks to stop by returning false. Records are only
+//timed after the "#T" anchor of their block, so begin should be a block start
+template <class F>
+bool forEachRecord(const char *begin, const char *end, uint64_t stopMicros, F f)
+{
+  edgeRecord r = {};
+  bool anchored = false;
+  const char *p = begin;
+  while (p < end)
+  {
+    const char *eol = (const char *)memchr(p, '\n', end - p);
+    if (eol == nullptr)
+      break; //torn last line
+    if (p[0] == '#')
+    {
+      if (eol - p > 3 && p[1] == 'T' && p[2] == ',')
+      {
+        uint64_t seconds, micros;
+        const char *q = parseUnsigned(p + 3, eol, seconds);
+        if (q < eol && *q == ',')
+        {
+          parseUnsigned(q + 1, eol, micros);
+          r.micros = seconds * 1000000 + micros;
+          anchored = true;
+        }
+      }
+    }
+    else if (anchored && p[0] >= '0' && p[0] <= '9')
+    {
+      uint64_t delta, value;
+      const char *q = parseUnsigned(p, eol, delta);
+      r.micros += delta;
+      if (r.micros >= stopMicros)
+        return true;
+      r.numValues = 0;
+      while (q < eol && r.numValues < maxLogChannels)
+      {
+        while (q < eol && (*q == ' ' || *q == ','))
+          q++;
+        if (q == eol)
+          break;
+        q = parseUnsigned(q, eol, value);
+        r.values[r.numValues++] = value;
+      }
+      if (!f((const edgeRecord &)r))
+        return false;
+    }
+    p = eol + 1;
+  }
+  return true;
+}
+
+//a log of a unit and its index, the index is optional for logs older than the index
+struct edgeLog
+{
+  std::string logPath;
+  std::string indexPath;
+  uint32_t startTime = 0;
+  uint32_t channelMask = 0;
+  const logIndexEntry *entries = nullptr;
+  size_t numEntries = 0;
+  mappedFile log;
+  mappedFile index;
+
+  //maps the log and its index, an index that does not belong to the log is ignored
+  bool open()
+  {
+    if (!log.open(logPath))
+      return false;
+    entries = nullptr;
+    numEntries = 0;
+    if (!indexPath.empty() && index.open(indexPath) && index.size >= sizeof(logIndexHeader))
+    {
+      const logIndexHeader *header = (const logIndexHeader *)index.data;
+      if (header->magic == logIndexMagic && header->version == logIndexVersion && header->entrySize == sizeof(logIndexEntry))
+      {
+        entries = (const logIndexEntry *)(index.data + sizeof(logIndexHeader));
+        numEntries = (index.size - sizeof(logIndexHeader)) / sizeof(logIndexEntry);
+        //drop entries past the end of the log, a copy taken while the unit was writing
+        while (numEntries > 0 && entries[numEntries - 1].offset >= log.size)
+          numEntries--;
+      }
+    }
+    return true;
+  }
+
+  //column of the records that holds channel, -1 if the log does not have it. the
+  //edge refuses a mask change while recording, so the mask of the header holds for
+  //the whole log
+  int column(int channel) const
+  {
+    if (channel < 0 || channel >= maxLogChannels || (channelMask & (1u << channel)) == 0)
+      return -1;
+    return __builtin_popcount(channelMask & ((1u << channel) - 1));
+  }
+
+  //offset of the block holding the first record at or after fromMicros
+  size_t seek(uint64_t fromMicros) const
+  {
+    //last block anchored before fromMicros, its records may run past it
+    const logIndexEntry *first = std::partition_point(entries, entries + numEntries, [&](const logIndexEntry &e) {
+      return (uint64_t)e.seconds * 1000000 + e.micros <= fromMicros;
+    });
+    return first == entries ? 0 : (size_t)first[-1].offset;
+  }
+
+  template <class F>
+  bool query(uint64_t fromMicros, uint64_t toMicros, F f) const
+  {
+    size_t offset = seek(fromMicros);
+    return forEachRecord(log.data + offset, log.data + log.size, toMicros, [&](const edgeRecord &r) {
+      return r.micros < fromMicros || f(r);
+    });
+  }
+};
+
+//parses unix seconds or a UTC time, returns false on anything else
+static inline bool parseTime(const char *text, uint64_t &micros)
+{
+  int year, month, day, hour = 0, minute = 0, second = 0, consumed = 0;
+  const char *fraction;
+  if (sscanf(text, "%d-%d-%d%*1[T ]%d:%d:%d%n", &year, &month, &day, &hour, &minute, &second, &consumed) == 6 ||
+      sscanf(text, "%d-%d-%d%n", &year, &month, &day, &consumed) == 3)
+  {
+    tm t = {};
+    t.tm_year = year - 1900;
+    t.tm_mon = month - 1;
+    t.tm_mday = day;
+    t.tm_hour = hour;
+    t.tm_min = minute;
+    t.tm_sec = second;
+    micros = (uint64_t)timegm(&t) * 1000000;
+    fraction = text + consumed;
+  }
+  else
+  {
+    char *end;
+    micros = strtoull(text, &end, 10) * 1000000;
+    if (end == text)
+      return false;
+    fraction = end;
+  }
+  if (*fraction == '.')
+  {
+    uint64_t scale = 100000;
+    for (fraction++; *fraction >= '0' && *fraction <= '9'; fraction++, scale /= 10)
+      micros += (*fraction - '0') * scale;
+  }
+  return *fraction == '\0' || *fraction == 'Z';
+}
+
+//value below which a fraction p of the values lie, empty when there are none
+static inline double percentile(std::vector<double> values, double p, double empty = 0)
+{
+  if (values.empty())
+    return empty;
+  std::sort(values.begin(), values.end());
+  return values[std::min(values.size() - 1, (size_t)(p * values.size()))];
+}
+
+//reads the start time from the index header, or from the "#H" line of a log without one
+static inline bool readLogStart(edgeLog &l)
+{
+  FILE *f = l.indexPath.empty() ? nullptr : fopen(l.indexPath.c_str(), "rb");
+  if (f != nullptr)
+  {
+    logIndexHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == logIndexMagic;
+    fclose(f);
+    if (ok)
+    {
+      l.startTime = header.startTime;
+      l.channelMask = header.channelMask;
+      return true;
+    }
+    l.indexPath.clear();
+  }
+  f = fopen(l.logPath.c_str(), "rb");
+  if (f == nullptr)
+    return false;
+  char line[128];
+  bool found = false;
+  for (int i = 0; i < 8 && !found && fgets(line, sizeof(line), f) != nullptr; i++)
+  {
+    unsigned long startTime, sample, output, decimation, resolution, mask;
+    if (sscanf(line, "#H,%lu,%lu,%lu,%lu,%lu,%lx", &startTime, &sample, &output, &decimation, &resolution, &mask) == 6)
+    {
+      l.startTime = startTime;
+      l.channelMask = mask;
+      found = true;
+    }
+  }
+  fclose(f);
+  return found;
+}
+
+//finds the logs under the directory of a unit, YYYYMM/ddhhmmss.CSV, in time order
+static inline std::vector<edgeLog> findLogs(const std::string &directory)
+{
+  namespace fs = std::filesystem;
+  std::vector<edgeLog> logs;
+  std::error_code ec;
+  for (fs::recursive_directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec))
+  {
+    if (!it->is_regular_file())
+      continue;
+    std::string extension = it->path().extension().string();
+    if (extension != ".CSV" && extension != ".csv")
+      continue;
+    edgeLog l;
+    l.logPath = it->path().string();
+    fs::path indexPath = it->path();
+    indexPath.replace_extension(extension == ".CSV" ? ".IDX" : ".idx");
+    if (fs::exists(indexPath))
+      l.indexPath = indexPath.string();
+    if (readLogStart(l))
+      logs.push_back(std::move(l));
+  }
+  std::sort(logs.begin(), logs.end(), [](const edgeLog &a, const edgeLog &b) { return a.startTime < b.startTime; });
+  return logs;
+}
+
+#endif
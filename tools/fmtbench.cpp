@@ -0,0 +1,193 @@
+// Compares the formatting of log lines before and after fmt.h.
+//
+//   fmtbench [lines]
+//
+// Formats the record line of the edge ("delta , p0 , p1 , p2" with a "#T" anchor
+// every 20 records) and the gps line of the coordinator (8 decimals) three ways:
+// String style concatenation (std::string stands in for the Arduino String, the
+// gps fix with String(double, 8) done by printf "%.8f"), snprintf into a stack
+// buffer and fmtLine. Prints the time per line, the throughput and the heap
+// allocations per line, counted by replacing operator new.
+//
+// build: g++ -O2 -std=c++17 -I.. -o fmtbench fmtbench.cpp
+
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include "fmt.h"
+
+static size_t numAllocations = 0;
+
+void *operator new(size_t size)
+{
+  numAllocations++;
+  void *p = malloc(size ? size : 1);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+//the inputs of one line, varied so the compiler cannot fold the formatting
+struct sample
+{
+  uint32_t seconds;
+  uint32_t micros;
+  uint32_t delta;
+  uint32_t p[3];
+  double latitude;
+  double longitude;
+};
+
+static sample makeSample(uint32_t i)
+{
+  return {1760870000 + i / 20, (i * 50000) % 1000000, 50000 + i % 7, {400 + i % 3000, 3500 - i % 1000, 2048 + i % 17},
+          42.36 + (i % 100000) * 1e-8, -71.05 - (i % 100000) * 1e-8};
+}
+
+static size_t stringRecord(const sample &s, bool anchor, char *out)
+{
+  std::string line = "";
+  if (anchor)
+  {
+    line += "#T,";
+    line += std::to_string(s.seconds);
+    line += ",";
+    std::string micros = std::to_string(s.micros);
+    line += std::string(6 - micros.size(), '0') + micros;
+    line += "\n";
+  }
+  line += std::to_string(s.delta);
+  for (uint32_t v : s.p)
+  {
+    line += " , ";
+    line += std::to_string(v);
+  }
+  line += "\n";
+  memcpy(out, line.data(), line.size());
+  return line.size();
+}
+
+static size_t snprintfRecord(const sample &s, bool anchor, char *out)
+{
+  int n = 0;
+  if (anchor)
+    n = snprintf(out, 128, "#T,%lu,%06lu\n", (unsigned long)s.seconds, (unsigned long)s.micros);
+  n += snprintf(out + n, 128 - n, "%lu", (unsigned long)s.delta);
+  for (uint32_t v : s.p)
+    n += snprintf(out + n, 128 - n, " , %lu", (unsigned long)v);
+  out[n++] = '\n';
+  return n;
+}
+
+static size_t fmtRecord(const sample &s, bool anchor, char *out)
+{
+  fmtLine<128> line;
+  if (anchor)
+    line.addText("#T,").addUnsigned(s.seconds).addChar(',').addPadded(s.micros, 6).addChar('\n');
+  line.addUnsigned(s.delta);
+  for (uint32_t v : s.p)
+    line.addText(" , ").addUnsigned(v);
+  line.addChar('\n');
+  memcpy(out, line.data, line.length);
+  return line.length;
+}
+
+static std::string stringDouble(double v)
+{
+  char digits[32];
+  snprintf(digits, sizeof(digits), "%.8f", v);
+  return digits;
+}
+
+static size_t stringGps(const sample &s, bool, char *out)
+{
+  std::string line = "";
+  line += std::to_string(s.seconds);
+  line += ".";
+  std::string millis = std::to_string(s.micros / 1000);
+  line += std::string(3 - millis.size(), '0') + millis;
+  line += " , ";
+  line += stringDouble(s.latitude);
+  line += " , ";
+  line += stringDouble(s.longitude);
+  line += "\n";
+  memcpy(out, line.data(), line.size());
+  return line.size();
+}
+
+static size_t snprintfGps(const sample &s, bool, char *out)
+{
+  return snprintf(out, 128, "%lu.%03lu , %.8f , %.8f\n", (unsigned long)s.seconds, (unsigned long)(s.micros / 1000), s.latitude,
+                  s.longitude);
+}
+
+static size_t fmtGps(const sample &s, bool, char *out)
+{
+  fmtLine<128> line;
+  line.addUnsigned(s.seconds).addChar('.').addPadded(s.micros / 1000, 3);
+  line.addText(" , ").addFixed(llround(s.latitude * 1e8), 8).addText(" , ").addFixed(llround(s.longitude * 1e8), 8);
+  line.addChar('\n');
+  memcpy(out, line.data, line.length);
+  return line.length;
+}
+
+typedef size_t (*formatter)(const sample &, bool, char *);
+
+static void run(const char *name, formatter f, uint32_t numLines)
+{
+  char out[256];
+  size_t bytes = 0;
+  uint32_t check = 0;
+  size_t allocationsBefore = numAllocations;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < numLines; i++)
+  {
+    size_t n = f(makeSample(i), i % 20 == 0, out);
+    bytes += n;
+    check += (uint8_t)out[n / 2];
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%-18s %8.1f ns/line %8.1f MB/s %6.2f allocations/line   (check %u)\n", name, seconds * 1e9 / numLines,
+         bytes / seconds / 1e6, (double)(numAllocations - allocationsBefore) / numLines, check);
+}
+
+//the three ways have to produce the same text
+static bool same(formatter a, formatter b, uint32_t numLines)
+{
+  char x[256], y[256];
+  for (uint32_t i = 0; i < numLines; i++)
+  {
+    size_t n = a(makeSample(i), i % 20 == 0, x);
+    if (n != b(makeSample(i), i % 20 == 0, y) || memcmp(x, y, n) != 0)
+    {
+      fprintf(stderr, "line %u differs: %.*s", i, (int)n, x);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t numLines = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000000;
+  if (!same(stringRecord, fmtRecord, 100000) || !same(snprintfRecord, fmtRecord, 100000) || !same(stringGps, fmtGps, 100000) ||
+      !same(snprintfGps, fmtGps, 100000))
+    return 1;
+  printf("edge record, %u lines\n", numLines);
+  run("String +=", stringRecord, numLines);
+  run("snprintf", snprintfRecord, numLines);
+  run("fmtLine", fmtRecord, numLines);
+  printf("coordinator gps line, %u lines\n", numLines);
+  run("String(double, 8)", stringGps, numLines);
+  run("snprintf %.8f", snprintfGps, numLines);
+  run("fmtLine", fmtGps, numLines);
+  return 0;
+}
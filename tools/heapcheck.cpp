@@ -0,0 +1,207 @@
+// Fails the build when the heap can be reached from loop().
+//
+//   arm-none-eabi-objdump -d edge.ino.elf | heapcheck [--root <function>] ... [--allow <function>] ...
+//
+// Reads the disassembly of the firmware and builds its static call graph: every
+// direct call or branch from one function to another is an edge. The graph is
+// searched from the roots, loop by default, for the allocators of the C and C++
+// libraries (malloc, calloc, realloc, operator new and their reentrant forms).
+// Every allocator that can be reached is printed with the shortest chain of calls
+// that reaches it and the exit status is 1.
+//
+// Functions are named as demangled without their arguments, e.g. writeData or
+// SDClass::open. --root adds a root, such as the sampleTouch timer callback of the
+// coordinator. --allow stops the search at a function, for the cold paths that
+// allocate on purpose: opening a log file when a recording starts allocates the
+// file object of the Teensy SD library. Calls through function pointers and
+// virtual functions do not appear in the disassembly and are not followed.
+// heapcheck.sh runs it on both firmwares with their roots and allowed functions.
+//
+// build: g++ -O2 -std=c++17 -o heapcheck heapcheck.cpp
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <set>
+#include <string>
+#include <vector>
+
+struct function
+{
+  std::string symbol;
+  std::string name; //demangled, without the arguments
+  std::set<int> calls;
+};
+
+static std::vector<function> functions;
+static std::map<std::string, int> bySymbol;
+
+static std::string shortName(const std::string &symbol)
+{
+  int status = 0;
+  char *demangled = abi::__cxa_demangle(symbol.c_str(), nullptr, nullptr, &status);
+  std::string name = status == 0 && demangled != nullptr ? demangled : symbol;
+  free(demangled);
+  size_t paren = name.find('(');
+  return paren == std::string::npos ? name : name.substr(0, paren);
+}
+
+static int functionOf(std::string symbol)
+{
+  size_t at = symbol.find('@'); //malloc@plt on a host build
+  if (at != std::string::npos)
+    symbol.resize(at);
+  auto it = bySymbol.find(symbol);
+  if (it != bySymbol.end())
+    return it->second;
+  functions.push_back({symbol, shortName(symbol), {}});
+  return bySymbol[symbol] = functions.size() - 1;
+}
+
+static bool isAllocator(const std::string &symbol)
+{
+  static const char *const allocators[] = {"malloc", "calloc", "realloc", "memalign", "_malloc_r",
+                                           "_calloc_r", "_realloc_r", "_memalign_r"};
+  for (const char *a : allocators)
+  {
+    if (symbol == a)
+      return true;
+  }
+  //operator new and new[] in all their overloads
+  return symbol.compare(0, 4, "_Znw") == 0 || symbol.compare(0, 4, "_Zna") == 0;
+}
+
+static bool isHexBytes(const std::string &field)
+{
+  return !field.empty() && field.find_first_not_of("0123456789abcdef ") == std::string::npos;
+}
+
+//adds the edges of one line of objdump -d output, returns the function a header line starts
+static void parseLine(const std::string &line, int &current)
+{
+  //function header: "00000abc <loop>:"
+  if (!line.empty() && line.back() == ':' && line.find(" <") != std::string::npos && line[0] != ' ')
+  {
+    size_t open = line.find(" <");
+    current = functionOf(line.substr(open + 2, line.size() - open - 4));
+    return;
+  }
+  size_t open = line.find('<');
+  size_t close = line.find('>', open);
+  if (current < 0 || open == std::string::npos || close == std::string::npos)
+    return;
+  //"addr:\tbytes\tmnemonic\toperands" on arm, "addr:\tbytes\tmnemonic operands" on x86
+  std::vector<std::string> fields;
+  for (size_t start = 0, tab; start <= line.size(); start = tab + 1)
+  {
+    tab = line.find('\t', start);
+    if (tab == std::string::npos)
+      tab = line.size();
+    fields.push_back(line.substr(start, tab - start));
+  }
+  if (fields.size() < 3)
+    return;
+  std::string instruction = isHexBytes(fields[1]) ? fields[2] : fields[1];
+  std::string mnemonic = instruction.substr(0, instruction.find(' '));
+  //bl, blx, b.w, beq.n on arm, call and jmp on x86
+  if (mnemonic.empty() || (mnemonic[0] != 'b' && mnemonic != "call" && mnemonic != "callq" && mnemonic[0] != 'j'))
+    return;
+  std::string target = line.substr(open + 1, close - open - 1);
+  size_t plus = target.find('+');
+  if (plus != std::string::npos)
+    target.resize(plus);
+  int callee = functionOf(target);
+  if (callee != current)
+    functions[current].calls.insert(callee);
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<std::string> roots, allowed;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--root") == 0 && i + 1 < argc)
+      roots.push_back(argv[++i]);
+    else if (strcmp(argv[i], "--allow") == 0 && i + 1 < argc)
+      allowed.push_back(argv[++i]);
+    else
+    {
+      fprintf(stderr, "usage: objdump -d firmware.elf | %s [--root <function>] ... [--allow <function>] ...\n", argv[0]);
+      return 2;
+    }
+  }
+  if (roots.empty())
+    roots.push_back("loop");
+
+  std::string line;
+  int current = -1;
+  while (std::getline(std::cin, line))
+    parseLine(line, current);
+
+  auto matches = [](const function &f, const std::vector<std::string> &names) {
+    for (const std::string &n : names)
+    {
+      if (f.name == n || f.symbol == n)
+        return true;
+    }
+    return false;
+  };
+  //breadth first, so the chain printed for an allocator is a shortest one
+  std::vector<int> parent(functions.size(), -2);
+  std::queue<int> pending;
+  for (size_t f = 0; f < functions.size(); f++)
+  {
+    if (matches(functions[f], roots))
+    {
+      parent[f] = -1;
+      pending.push(f);
+    }
+  }
+  if (pending.empty())
+  {
+    fprintf(stderr, "no root function found in the disassembly\n");
+    return 2;
+  }
+  size_t numReached = 0;
+  std::vector<int> reachedAllocators;
+  while (!pending.empty())
+  {
+    int f = pending.front();
+    pending.pop();
+    numReached++;
+    if (isAllocator(functions[f].symbol))
+    {
+      reachedAllocators.push_back(f);
+      continue;
+    }
+    if (parent[f] != -1 && matches(functions[f], allowed))
+      continue;
+    for (int callee : functions[f].calls)
+    {
+      if (parent[callee] == -2)
+      {
+        parent[callee] = f;
+        pending.push(callee);
+      }
+    }
+  }
+  for (int a : reachedAllocators)
+  {
+    std::vector<int> chain;
+    for (int f = a; f >= 0; f = parent[f])
+      chain.push_back(f);
+    for (size_t i = chain.size(); i > 0; i--)
+      printf("%s%s", functions[chain[i - 1]].name.c_str(), i > 1 ? " -> " : "\n");
+  }
+  if (!reachedAllocators.empty())
+  {
+    printf("%zu allocators reachable\n", reachedAllocators.size());
+    return 1;
+  }
+  printf("no allocator reachable from %zu functions\n", numReached);
+  return 0;
+}
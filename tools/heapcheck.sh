@@ -0,0 +1,38 @@
+#!/bin/sh
+# Checks that loop() of both sketches cannot reach the heap.
+#
+#   heapcheck.sh <edge.ino.elf> <coordinator.ino.elf>
+#
+# Builds heapcheck.cpp into a temporary directory and runs it on the disassembly
+# of each firmware. The allowed functions are the cold paths that open a file,
+# the SD library allocates the file object; they are kept out of line in the
+# sketches so they appear by name. The coordinator is also searched from
+# sampleTouch, called by the touch timer through a pointer. OBJDUMP overrides
+# arm-none-eabi-objdump. Exits non-zero if either firmware reaches an allocator
+# or cannot be read.
+
+tools=$(dirname "$0")
+objdump=${OBJDUMP:-arm-none-eabi-objdump}
+
+if [ $# -ne 2 ]; then
+  echo "usage: $0 <edge.ino.elf> <coordinator.ino.elf>" >&2
+  exit 2
+fi
+work=$(mktemp -d) || exit 2
+trap 'rm -rf "$work"' EXIT
+g++ -O2 -std=c++17 -o "$work/heapcheck" "$tools/heapcheck.cpp" || exit 2
+
+#check <name> <elf> <heapcheck arguments>...
+check()
+{
+  echo "$1: $2"
+  elf=$2
+  shift 2
+  "$objdump" -d "$elf" > "$work/dis" || return 2
+  "$work/heapcheck" "$@" < "$work/dis"
+}
+
+status=0
+check edge "$1" --allow openLogFiles --allow updateTrace || status=1
+check coordinator "$2" --root loop --root sampleTouch --allow logService::openFile --allow setTrace || status=1
+exit $status
@@ -0,0 +1,236 @@
+// Cuts the power under the journal of the edge and checks what recovery keeps.
+//
+//   journaltest [runs] [seed]
+//
+// Every run writes records and "#T" anchors to a log and its index on an
+// in-memory card, the way writeData() does, then cuts the power at a random
+// point. The card keeps what was flushed and a random part of what was written
+// after it, possibly ending in a torn sector of garbage. recoverFile() and
+// recoverIndex() then have to keep every block up to the last flush, cut the log
+// at a block end with everything before it intact and leave only the index
+// entries of blocks that are still in the log. Exits with 1 on the first run that
+// fails, printing its seed.
+//
+// build: g++ -O2 -std=c++17 -I.. -o journaltest journaltest.cpp
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#define FILE_READ 0
+#define FILE_WRITE 1
+
+#include "journal.h"
+
+//contents of a file on the card, the bytes before flushed survive a power cut
+struct memData
+{
+  std::vector<uint8_t> bytes;
+  size_t flushed = 0;
+};
+
+//the part of the File of the SD library the journal uses
+class memFile
+{
+  public:
+  std::shared_ptr<memData> data;
+  size_t position = 0;
+
+  explicit operator bool() const { return data != nullptr; }
+
+  size_t write(const uint8_t *p, size_t n)
+  {
+    if (data->bytes.size() < position + n)
+      data->bytes.resize(position + n);
+    memcpy(data->bytes.data() + position, p, n);
+    position += n;
+    return n;
+  }
+
+  int read(void *p, size_t n)
+  {
+    size_t available = position < data->bytes.size() ? data->bytes.size() - position : 0;
+    n = n < available ? n : available;
+    memcpy(p, data->bytes.data() + position, n);
+    position += n;
+    return n;
+  }
+
+  bool seek(uint64_t p)
+  {
+    position = p;
+    return p <= data->bytes.size();
+  }
+
+  uint64_t size() const { return data->bytes.size(); }
+
+  bool truncate(uint64_t length)
+  {
+    data->bytes.resize(length);
+    data->flushed = data->flushed < length ? data->flushed : length;
+    return true;
+  }
+
+  void flush() { data->flushed = data->bytes.size(); }
+  void close() { data = nullptr; }
+};
+
+class memCard
+{
+  public:
+  std::map<std::string, std::shared_ptr<memData>> files;
+
+  //FILE_WRITE opens at the end of the file and creates it, as on the Teensy
+  memFile open(const char *name, uint8_t mode = FILE_READ)
+  {
+    memFile f;
+    auto it = files.find(name);
+    if (it == files.end())
+    {
+      if (mode != FILE_WRITE)
+        return f;
+      it = files.emplace(name, std::make_shared<memData>()).first;
+    }
+    f.data = it->second;
+    f.position = mode == FILE_WRITE ? f.data->bytes.size() : 0;
+    return f;
+  }
+
+  bool remove(const char *name) { return files.erase(name) > 0; }
+
+  //keeps the flushed bytes of every file and a random part of the rest. the last
+  //sector written to a log may be torn and hold garbage, an index is only cut: its
+  //entries carry no crc and recoverIndex() only checks their offsets
+  void cutPower(std::mt19937 &random)
+  {
+    for (auto &file : files)
+    {
+      memData &d = *file.second;
+      size_t keep = d.flushed + random() % (d.bytes.size() - d.flushed + 1);
+      d.bytes.resize(keep);
+      if (file.first.find(".CSV") != std::string::npos && random() % 4 == 0)
+      {
+        size_t torn = random() % 512;
+        for (size_t i = 0; i < torn; i++)
+          d.bytes.push_back(random() % 4 == 0 ? '#' : random());
+      }
+      d.flushed = d.bytes.size();
+    }
+  }
+};
+
+static uint32_t now = 0;
+
+static uint32_t fakeMillis()
+{
+  return now;
+}
+
+typedef journal<memFile, memCard> memJournal;
+
+static bool fail(uint32_t seed, const char *what)
+{
+  fprintf(stderr, "seed %u: %s\n", seed, what);
+  return false;
+}
+
+static bool run(uint32_t seed)
+{
+  std::mt19937 random(seed);
+  memCard card;
+  memJournal log(card, fakeMillis, "ACTIVE.JNL");
+  now = 0;
+  log.open("01000000.CSV");
+  log.openIndex("01000000.IDX", 1760870000, 7);
+  const char *header = "#H,1760870000,20000,1,1,12,7\n";
+  log.append(header, strlen(header));
+
+  //what recovery is checked against
+  std::vector<uint8_t> written;
+  std::set<uint64_t> blockEnds = {0};
+  std::vector<logIndexEntry> entries;
+  uint64_t captureMicros = 1760870000ull * 1000000;
+  uint32_t numRecords = random() % 4000;
+  for (uint32_t i = 0; i < numRecords; i++)
+  {
+    now += random() % 40;
+    captureMicros += 20000 + random() % 100;
+    fmtLine<64> record;
+    record.addUnsigned(20000 + random() % 100);
+    for (int c = 0; c < 3; c++)
+      record.addText(" , ").addUnsigned(random() % 4096);
+    record.addChar('\n');
+    log.reserve(record.length + 32);
+    blockEnds.insert(log.fileOffset);
+    if (!log.anchored)
+    {
+      fmtLine<32> anchor;
+      anchor.addText("#T,").addUnsigned(captureMicros / 1000000).addChar(',').addPadded(captureMicros % 1000000, 6).addChar('\n');
+      log.append(anchor.data, anchor.length);
+      log.anchored = true;
+      log.anchorSeconds = captureMicros / 1000000;
+      log.anchorMicros = captureMicros % 1000000;
+      entries.push_back({log.anchorSeconds, log.anchorMicros, log.fileOffset});
+    }
+    log.append(record.data, record.length);
+    blockEnds.insert(log.fileOffset);
+  }
+  //blocks and index entries that were flushed, and the content written so far
+  uint64_t flushedEnd = card.files["01000000.CSV"]->flushed;
+  size_t indexFlushed = card.files["01000000.IDX"]->flushed;
+  size_t flushedEntries = indexFlushed > sizeof(logIndexHeader) ? (indexFlushed - sizeof(logIndexHeader)) / sizeof(logIndexEntry) : 0;
+  written = card.files["01000000.CSV"]->bytes;
+  card.cutPower(random);
+
+  uint64_t truncated = 0;
+  uint64_t length = memJournal::recoverFile(card, "01000000.CSV", &truncated);
+  memJournal::recoverIndex(card, "01000000.IDX", length);
+  const std::vector<uint8_t> &recovered = card.files["01000000.CSV"]->bytes;
+  if (length != recovered.size())
+    return fail(seed, "recoverFile returned a length other than the file's");
+  if (length < flushedEnd)
+    return fail(seed, "a flushed block was lost");
+  if (blockEnds.count(length) == 0)
+    return fail(seed, "the log was not cut at a block end");
+  if (length > written.size() || memcmp(recovered.data(), written.data(), length) != 0)
+    return fail(seed, "the recovered log differs from what was written");
+
+  //an index whose header was never flushed is emptied
+  const std::vector<uint8_t> &index = card.files["01000000.IDX"]->bytes;
+  if (index.empty() && indexFlushed < sizeof(logIndexHeader))
+    return true;
+  if (index.size() < sizeof(logIndexHeader) || (index.size() - sizeof(logIndexHeader)) % sizeof(logIndexEntry) != 0)
+    return fail(seed, "the index holds a torn entry");
+  size_t numEntries = (index.size() - sizeof(logIndexHeader)) / sizeof(logIndexEntry);
+  if (numEntries < flushedEntries)
+    return fail(seed, "a flushed index entry was lost");
+  for (size_t e = 0; e < numEntries; e++)
+  {
+    logIndexEntry entry;
+    memcpy(&entry, index.data() + sizeof(logIndexHeader) + e * sizeof(logIndexEntry), sizeof(entry));
+    if (e >= entries.size() || memcmp(&entry, &entries[e], sizeof(entry)) != 0)
+      return fail(seed, "an index entry differs from what was written");
+    if (entry.offset >= length)
+      return fail(seed, "an index entry points past the recovered log");
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t numRuns = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000;
+  uint32_t firstSeed = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1;
+  for (uint32_t seed = firstSeed; seed < firstSeed + numRuns; seed++)
+  {
+    if (!run(seed))
+      return 1;
+  }
+  printf("%u power cuts recovered\n", numRuns);
+  return 0;
+}
@@ -0,0 +1,61 @@
+// Prints the records an edge unit logged in a time range.
+//
+//   logquery <unit directory> <from> <to>
+//
+// from and to are unix seconds (fractions allowed) or UTC times such as
+// 2026-10-19T12:00:00.25. The directory holds the card contents of one unit,
+// YYYYMM/ddhhmmss.CSV with the .IDX index next to each log. Only logs that can
+// hold the range are mapped, and the index points at the first block of the
+// range, so a query over years of logs reads a few blocks. Records are printed
+// as "seconds.micros,value,..." with one value per logged channel.
+//
+// build: g++ -O2 -std=c++17 -I.. -o logquery logquery.cpp
+
+#include <cinttypes>
+
+#include "edgelog.h"
+
+int main(int argc, char **argv)
+{
+  uint64_t fromMicros, toMicros;
+  if (argc != 4 || !parseTime(argv[2], fromMicros) || !parseTime(argv[3], toMicros))
+  {
+    fprintf(stderr, "usage: %s <unit directory> <from> <to>\n", argv[0]);
+    return 1;
+  }
+  std::vector<edgeLog> logs = findLogs(argv[1]);
+  if (logs.empty())
+  {
+    fprintf(stderr, "%s: no logs found\n", argv[1]);
+    return 1;
+  }
+  static char out[1 << 16];
+  setvbuf(stdout, out, _IOFBF, sizeof(out));
+  size_t printed = 0;
+  for (size_t i = 0; i < logs.size(); i++)
+  {
+    //a log ends where the next one starts
+    if ((uint64_t)logs[i].startTime * 1000000 >= toMicros ||
+        (i + 1 < logs.size() && (uint64_t)logs[i + 1].startTime * 1000000 <= fromMicros))
+      continue;
+    edgeLog &l = logs[i];
+    if (!l.open())
+    {
+      perror(l.logPath.c_str());
+      continue;
+    }
+    l.query(fromMicros, toMicros, [&](const edgeRecord &r) {
+      printf("%" PRIu64 ".%06" PRIu64, r.micros / 1000000, r.micros % 1000000);
+      for (uint8_t c = 0; c < r.numValues; c++)
+        printf(",%u", r.values[c]);
+      printf("\n");
+      printed++;
+      return true;
+    });
+    l.log.close();
+    l.index.close();
+  }
+  fflush(stdout);
+  fprintf(stderr, "%zu records\n", printed);
+  return 0;
+}
@@ -0,0 +1,138 @@
+// Measures the cost per channel of the sampler of the edge.
+//
+//   samplerbench [readings]
+//
+// Runs sampler<...> of sampler.h with 3, 8 and 16 channels against a stubbed
+// analogRead() that returns pseudo random 12 bit counts, and the same
+// accumulation written with a channel count only known at run time, as it was
+// before the sampler was templated. A record is a batch of read() calls followed
+// by average() and reset(). Prints the time per reading and per channel. The
+// ADC conversion itself is not part of it, on the unit every analogRead() waits
+// for one.
+//
+// build: g++ -O2 -std=c++17 -I.. -o samplerbench samplerbench.cpp
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#define INPUT 0
+
+static uint32_t adcState = 1;
+static uint32_t fakeMicros = 0;
+
+static inline uint16_t analogRead(uint8_t pin)
+{
+  adcState = adcState * 1664525u + 1013904223u;
+  return ((adcState >> 20) + pin) & 0x0FFF;
+}
+
+static inline uint32_t micros()
+{
+  return fakeMicros;
+}
+
+static inline void pinMode(uint8_t, uint8_t)
+{
+}
+
+#include "sampler.h"
+
+static const uint32_t readingsPerRecord = 20;
+
+//the accumulation with the channel count as a run time value
+class runtimeSampler
+{
+  public:
+  uint8_t numChannels;
+  uint8_t pins[16];
+  uint32_t sum[16];
+  uint16_t minimum[16];
+  uint16_t maximum[16];
+  uint32_t numReadings = 0;
+  uint32_t firstMicros = 0;
+  uint32_t lastMicros = 0;
+
+  explicit runtimeSampler(uint8_t channels) : numChannels(channels)
+  {
+    for (uint8_t c = 0; c < numChannels; c++)
+      pins[c] = c;
+    reset();
+  }
+
+  void read()
+  {
+    lastMicros = micros();
+    if (numReadings == 0)
+      firstMicros = lastMicros;
+    for (uint8_t c = 0; c < numChannels; c++)
+    {
+      uint16_t reading = analogRead(pins[c]);
+      sum[c] += reading;
+      minimum[c] = reading < minimum[c] ? reading : minimum[c];
+      maximum[c] = reading > maximum[c] ? reading : maximum[c];
+    }
+    numReadings++;
+  }
+
+  void average(uint32_t *mean) const
+  {
+    uint32_t n = numReadings > 0 ? numReadings : 1;
+    for (uint8_t c = 0; c < numChannels; c++)
+      mean[c] = sum[c] / n;
+  }
+
+  void reset()
+  {
+    for (uint8_t c = 0; c < numChannels; c++)
+    {
+      sum[c] = 0;
+      minimum[c] = 0xFFFF;
+      maximum[c] = 0;
+    }
+    numReadings = 0;
+  }
+};
+
+template <class S>
+static void run(const char *name, S &s, uint8_t numChannels, uint32_t numReadings)
+{
+  uint32_t mean[16];
+  uint32_t check = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < numReadings; i++)
+  {
+    fakeMicros += 1000;
+    s.read();
+    if (s.numReadings == readingsPerRecord)
+    {
+      s.average(mean);
+      check += mean[i % numChannels] + s.minimum[0] + s.maximum[numChannels - 1];
+      s.reset();
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%-10s %2u channels %8.2f ns/reading %6.2f ns/channel   (check %u)\n", name, numChannels, seconds * 1e9 / numReadings,
+         seconds * 1e9 / numReadings / numChannels, check);
+}
+
+template <uint8_t... Pins>
+static void compare(uint32_t numReadings)
+{
+  sampler<Pins...> fixed;
+  runtimeSampler runtime(sizeof...(Pins));
+  adcState = 1;
+  run("template", fixed, sizeof...(Pins), numReadings);
+  adcState = 1;
+  run("runtime", runtime, sizeof...(Pins), numReadings);
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t numReadings = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000000;
+  compare<0, 1, 2>(numReadings);
+  compare<0, 1, 2, 3, 4, 5, 6, 7>(numReadings);
+  compare<0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15>(numReadings);
+  return 0;
+}
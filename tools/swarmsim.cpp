@@ -0,0 +1,757 @@
+// Load test of the coordinator/edge protocol on a simulated 802.15.4 channel.
+//
+//   swarmsim [--units 8,16,32,64,128] [--seconds 60] [--loss 0.01] [--no-ui-delays] [--seed 1]
+//
+// One coordinator and N edge units run the message sequences of coordinator.cpp
+// and edge.cpp, with the frames of protocol.h: the start handshake of
+// nodes::updateTime() / sendSetTimeAndPressure(), the round robin status polls
+// of pollUnits() and blocking nodes::configure() commands. The XBee radios are
+// modelled with the 115200 baud UART to the Teensy, unslotted CSMA-CA, MAC acks
+// and retries, airtime at 250 kbit/s, collisions between overlapping frames
+// and a random frame loss. Every unit hears every other unit.
+//
+// For every fleet size it reports the time to start the whole fleet, the clock
+// error each unit is left with, the goodput of the status polls, the measured
+// time between two polls of a unit (stretched by the commands that pause the
+// polls) and the latency of configuration commands. --no-ui-delays drops the
+// delay() calls the coordinator makes to show messages, leaving the protocol
+// limited start time.
+//
+// build: g++ -O2 -std=c++17 -I.. -o swarmsim swarmsim.cpp
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "edgelog.h"
+#include "edgeunit.h"
+#include "protocol.h"
+
+static const uint8_t numChannels = numPressureChannels;
+
+//times are in microseconds
+static const int64_t symbolMicros = 16;
+static const int64_t byteMicros = 2 * symbolMicros;    //250 kbit/s
+static const int64_t backoffPeriod = 20 * symbolMicros;
+static const int64_t ccaMicros = 8 * symbolMicros;
+static const int64_t turnaroundMicros = 12 * symbolMicros;
+static const int64_t ackWaitMicros = 54 * symbolMicros;
+static const int64_t uartByteMicros = 87;              //115200 baud, 10 bits per byte
+static const int phyOverhead = 6;                      //preamble, sfd, length
+static const int macOverhead = 11;                     //frame control, sequence, pan, 16 bit addresses, fcs
+static const int ackLength = 5;
+static const int apiOverhead = 9;                      //start, length, api id, frame id, address, option, checksum
+
+struct simulation
+{
+  int64_t now = 0;
+  uint64_t order = 0;
+  std::mt19937_64 random;
+  double loss = 0.01;
+  int64_t busyAirtime = 0;
+
+  struct event
+  {
+    int64_t time;
+    uint64_t order;
+    std::function<void()> action;
+    bool operator>(const event &other) const
+    {
+      return time != other.time ? time > other.time : order > other.order;
+    }
+  };
+  std::priority_queue<event, std::vector<event>, std::greater<event>> events;
+
+  void after(int64_t delay, std::function<void()> action)
+  {
+    events.push({now + delay, order++, std::move(action)});
+  }
+
+  void run(int64_t until)
+  {
+    while (!events.empty() && events.top().time <= until)
+    {
+      event e = events.top();
+      events.pop();
+      now = e.time;
+      e.action();
+    }
+    now = until;
+  }
+
+  bool lost()
+  {
+    return std::uniform_real_distribution<double>(0, 1)(random) < loss;
+  }
+
+  int64_t uniform(int64_t low, int64_t high)
+  {
+    return std::uniform_int_distribution<int64_t>(low, high)(random);
+  }
+};
+
+struct packet
+{
+  uint16_t source;
+  uint16_t destination;
+  uint8_t frameId;
+  std::vector<uint8_t> data;
+};
+
+class radio;
+
+struct transmission
+{
+  radio *sender;
+  int64_t start;
+  int64_t end;
+  bool collided;
+};
+
+class channel
+{
+  public:
+  simulation &sim;
+  std::vector<radio *> radios;
+  std::deque<std::shared_ptr<transmission>> active;
+
+  channel(simulation &s) : sim(s) {}
+
+  void expire()
+  {
+    while (!active.empty() && active.front()->end <= sim.now)
+      active.pop_front();
+  }
+
+  bool busy()
+  {
+    expire();
+    for (auto &t : active)
+    {
+      if (t->start <= sim.now && sim.now < t->end)
+        return true;
+    }
+    return false;
+  }
+
+  std::shared_ptr<transmission> start(radio *sender, int64_t airtime)
+  {
+    expire();
+    auto t = std::make_shared<transmission>(transmission{sender, sim.now, sim.now + airtime, false});
+    for (auto &other : active)
+    {
+      if (other->end > t->start)
+      {
+        other->collided = true;
+        t->collided = true;
+      }
+    }
+    //keep active ordered by end time for expire()
+    auto position = std::upper_bound(active.begin(), active.end(), t,
+                                     [](const std::shared_ptr<transmission> &a, const std::shared_ptr<transmission> &b) { return a->end < b->end; });
+    active.insert(position, t);
+    sim.busyAirtime += airtime;
+    return t;
+  }
+
+  radio *find(uint16_t address);
+};
+
+//an XBee in transparent 802.15.4 mode behind its UART
+class radio
+{
+  public:
+  simulation &sim;
+  channel &air;
+  uint16_t address;
+  std::function<void(const packet &)> onReceive;           //rx frame handed to the host
+  std::function<void(uint8_t frameId, bool)> onTxStatus;   //tx status frame handed to the host
+  std::deque<packet> queue;
+  bool sending = false;
+  int numBackoffs = 0;
+  int backoffExponent = 3;
+  int retries = 0;
+  bool acked = false;
+  int64_t transmittingUntil = 0;
+
+  radio(simulation &s, channel &c, uint16_t a) : sim(s), air(c), address(a)
+  {
+    air.radios.push_back(this);
+  }
+
+  //the host writes an api frame to the UART
+  void send(packet p)
+  {
+    p.source = address;
+    int64_t uart = (p.data.size() + apiOverhead) * uartByteMicros;
+    sim.after(uart, [this, p]() {
+      queue.push_back(p);
+      if (!sending)
+        startFrame();
+    });
+  }
+
+  void startFrame()
+  {
+    sending = true;
+    retries = 0;
+    startCsma();
+  }
+
+  void startCsma()
+  {
+    numBackoffs = 0;
+    backoffExponent = 3;
+    backoff();
+  }
+
+  void backoff()
+  {
+    int64_t delay = sim.uniform(0, (1 << backoffExponent) - 1) * backoffPeriod;
+    sim.after(delay + ccaMicros, [this]() {
+      if (air.busy())
+      {
+        numBackoffs++;
+        backoffExponent = std::min(backoffExponent + 1, 5);
+        if (numBackoffs > 4)
+          finish(false);
+        else
+          backoff();
+        return;
+      }
+      sim.after(turnaroundMicros, [this]() { transmit(); });
+    });
+  }
+
+  void transmit()
+  {
+    const packet p = queue.front();
+    int64_t airtime = (phyOverhead + macOverhead + p.data.size()) * byteMicros;
+    auto t = air.start(this, airtime);
+    transmittingUntil = t->end;
+    acked = false;
+    sim.after(airtime, [this, t, p]() {
+      radio *destination = air.find(p.destination);
+      if (destination != nullptr && !t->collided && destination->transmittingUntil <= t->start && !sim.lost())
+        destination->receive(p, this);
+      sim.after(ackWaitMicros, [this]() {
+        if (acked)
+          finish(true);
+        else if (++retries <= 3)
+          startCsma();
+        else
+          finish(false);
+      });
+    });
+  }
+
+  void receive(const packet &p, radio *sender)
+  {
+    //the ack is sent without csma after the turnaround time
+    sim.after(turnaroundMicros, [this, sender]() {
+      int64_t airtime = (phyOverhead + ackLength) * byteMicros;
+      auto t = air.start(this, airtime);
+      transmittingUntil = t->end;
+      sim.after(airtime, [t, sender, this]() {
+        if (!t->collided && !sim.lost())
+          sender->acked = true;
+      });
+    });
+    int64_t uart = (p.data.size() + apiOverhead) * uartByteMicros;
+    sim.after(uart, [this, p]() {
+      if (onReceive)
+        onReceive(p);
+    });
+  }
+
+  void finish(bool success)
+  {
+    uint8_t frameId = queue.front().frameId;
+    queue.pop_front();
+    if (frameId != 0)
+    {
+      sim.after(7 * uartByteMicros, [this, frameId, success]() {
+        if (onTxStatus)
+          onTxStatus(frameId, success);
+      });
+    }
+    if (queue.empty())
+      sending = false;
+    else
+      startFrame();
+  }
+};
+
+radio *channel::find(uint16_t address)
+{
+  for (radio *r : radios)
+  {
+    if (r->address == address)
+      return r;
+  }
+  return nullptr;
+}
+
+static std::vector<uint8_t> valueFrame(uint32_t value)
+{
+  std::vector<uint8_t> data(4);
+  encodeUint32(data.data(), value);
+  return data;
+}
+
+//edge.cpp: answers the start handshake, status polls and configuration frames. the
+//replies to polls and configuration frames are built by edgeunit.h like on the unit
+class edgeModel
+{
+  public:
+  static const uint32_t bytesPerRecord = 32;
+  simulation &sim;
+  radio xbee;
+  int64_t busyUntil = 0;     //the handshake blocks the loop with delay()
+  int64_t syncError = 0;     //rtc second edge of the unit minus the coordinator's
+  bool synced = false;
+  edgeConfig config = defaultEdgeConfig;
+  secondEdge rtcEdge;
+  uint32_t recordsWritten = 0;
+  uint64_t sdFreeBytes = 30000ull << 20;
+
+  edgeModel(simulation &s, channel &c, uint16_t address) : sim(s), xbee(s, c, address)
+  {
+    xbee.onReceive = [this](const packet &p) { receive(p); };
+    tick();
+  }
+
+  //micros() of the unit
+  uint32_t micros()
+  {
+    return (uint32_t)sim.now;
+  }
+
+  //updateSecondEdge() runs every pass of loop(), a little after the rtc ticks or when the
+  //handshake stops blocking the loop. the records of the second are counted with it
+  void tick()
+  {
+    rtcEdge.update(clock(sim.now), micros());
+    if (synced)
+      recordsWritten += 1000 / config.outputIntervalMillis;
+    int64_t nextEdge = ((sim.now - syncError) / 1000000 + 1) * 1000000 + syncError;
+    int64_t at = std::max(nextEdge + sim.uniform(0, 200), busyUntil);
+    sim.after(at - sim.now, [this]() { tick(); });
+  }
+
+  void sendToCoordinator(std::vector<uint8_t> data, uint8_t frameId)
+  {
+    xbee.send(packet{0, 0x0000, frameId, std::move(data)});
+  }
+
+  void receive(const packet &p)
+  {
+    if (sim.now < busyUntil)
+      return;//read and discarded by flushAPI() after the handshake
+    if (p.data.size() == statusRequestLength && p.data[0] == statusMarker)
+    {
+      std::vector<uint8_t> reply(statusReplyLength);
+      answerStatusRequest(p.data[1], (synced ? statusRecording : 0) | statusSdOk, recordsWritten, sdFreeBytes,
+                          (uint64_t)recordsWritten * bytesPerRecord, 0, rtcEdge, micros(), reply.data());
+      sendToCoordinator(reply, 0);
+      return;
+    }
+    if (p.data.size() == configFrameLength && p.data[0] == configMarker)
+    {
+      std::vector<uint8_t> reply(configFrameLength);
+      //a set takes effect at once, the model writes no records a change could split
+      answerConfigFrame(p.data.data(), config, synced, reply.data());
+      sendToCoordinator(reply, 1);
+      return;
+    }
+    if (p.data.size() != 4)
+      return;
+    uint32_t value = decodeUint32(p.data.data());
+    if (value > 1000000)
+    {
+      //Teensy3Clock.set() starts the second when the frame arrives
+      int64_t coordinatorEdge = (int64_t)value * 1000000;
+      syncError = sim.now - coordinatorEdge;
+      synced = true;
+      recordsWritten = 0;
+      rtcEdge.restart();
+      rtcEdge.update(clock(sim.now), micros());
+      //sendSetTimeAndPressure(): time, 20 readings of every channel, a packet per channel and the sd status
+      sendToCoordinator(valueFrame(value), 1);
+      int64_t t = (20 * numChannels + 100) * 1000;
+      for (uint8_t c = 0; c < numChannels; c++)
+      {
+        sim.after(t, [this]() { sendToCoordinator(valueFrame(2031), 1); });
+        t += 100000;
+      }
+      sim.after(t, [this]() { sendToCoordinator(valueFrame(1), 1); });
+      busyUntil = sim.now + t + 100000;
+    }
+  }
+
+  //seconds on the rtc of the unit
+  uint32_t clock(int64_t at)
+  {
+    return (uint32_t)((at - syncError) / 1000000);
+  }
+};
+
+struct statistics
+{
+  std::vector<double> values;
+
+  void add(double v)
+  {
+    values.push_back(v);
+  }
+
+  double percentile(double p)
+  {
+    return ::percentile(values, p);
+  }
+};
+
+//coordinator.cpp: the blocking start handshake and configure() run as a chain of
+//callbacks, pollUnits() runs whenever no command is in flight
+class coordinatorModel
+{
+  public:
+  simulation &sim;
+  radio xbee;
+  std::vector<std::unique_ptr<edgeModel>> &units;
+  bool uiDelays;
+  bool commandInFlight = false;
+  std::function<void(const packet *, int, bool)> waiting; //frame or tx status, nullptr on timeout
+  uint64_t waitToken = 0;
+
+  //results
+  int64_t fleetStarted = -1;
+  int startFailures = 0;
+  int startRetries = 0;
+  uint64_t pollsSent = 0;
+  uint64_t pollReplies = 0;
+  uint64_t commandsFailed = 0;
+  statistics pollRoundTrip;
+  statistics pollCycle; //seconds between two polls of the same unit
+  statistics commandLatency;
+  bool measuring = false;
+
+  //poll state
+  size_t pollIndex = 0;
+  std::vector<uint8_t> pollSequence;
+  std::vector<int64_t> pollSent;
+  std::vector<int64_t> lastPolled;
+
+  coordinatorModel(simulation &s, channel &c, std::vector<std::unique_ptr<edgeModel>> &u, bool ui)
+    : sim(s), xbee(s, c, 0x0000), units(u), uiDelays(ui), pollSequence(u.size()), pollSent(u.size()), lastPolled(u.size())
+  {
+    xbee.onReceive = [this](const packet &p) { receive(&p, -1, false); };
+    xbee.onTxStatus = [this](uint8_t frameId, bool success) { receive(nullptr, frameId, success); };
+  }
+
+  void receive(const packet *p, int frameId, bool success)
+  {
+    if (waiting)
+    {
+      auto handler = waiting;
+      waiting = nullptr;
+      waitToken++;
+      handler(p, frameId, success);
+      return;
+    }
+    if (p != nullptr && p->data.size() == statusReplyLength && p->data[0] == statusMarker)
+    {
+      size_t i = p->source - 0x00E0;
+      if (i < units.size() && p->data[1] == pollSequence[i] && pollSent[i] != 0)
+      {
+        if (measuring)
+        {
+          pollReplies++;
+          pollRoundTrip.add((sim.now - pollSent[i]) / 1000.0);
+        }
+        pollSent[i] = 0;
+      }
+    }
+  }
+
+  //xbee.readPacket(timeout): handler gets the next frame or nullptr after timeout
+  void waitFrame(int64_t timeout, std::function<void(const packet *, int, bool)> handler)
+  {
+    waiting = handler;
+    uint64_t token = ++waitToken;
+    sim.after(timeout, [this, token]() {
+      if (waiting && waitToken == token)
+      {
+        auto h = waiting;
+        waiting = nullptr;
+        h(nullptr, -1, false);
+      }
+    });
+  }
+
+  void delay(int64_t micros, std::function<void()> next)
+  {
+    sim.after(uiDelays ? micros : 0, next);
+  }
+
+  uint16_t address(size_t i)
+  {
+    return 0x00E0 + i;
+  }
+
+  //nodes::updateTime() for every unit, the operator taps the next unit when the previous is done
+  void startFleet(size_t i, std::function<void()> done)
+  {
+    if (i == units.size())
+    {
+      fleetStarted = sim.now;
+      done();
+      return;
+    }
+    commandInFlight = true;
+    //the touch screen is sampled every 2 s
+    sim.after(sim.uniform(0, 2000000), [this, i, done]() { updateTime(i, 1, [this, i, done]() { startFleet(i + 1, done); }); });
+  }
+
+  void updateTime(size_t i, int numTries, std::function<void()> done)
+  {
+    if (numTries > 5)
+    {
+      startFailures++;
+      commandInFlight = false;
+      done();
+      return;
+    }
+    if (numTries > 1)
+      startRetries++;
+    auto retry = [this, i, numTries, done]() { delay(5000000, [this, i, numTries, done]() { updateTime(i, numTries + 1, done); }); };
+    //getCurrentTime() waits for the next second edge
+    int64_t nextSecond = (sim.now / 1000000 + 1) * 1000000;
+    sim.after(nextSecond - sim.now, [this, i, retry, done]() {
+      uint32_t t = sim.now / 1000000;
+      int64_t startOfTransmission = sim.now;
+      xbee.send(packet{0, address(i), 1, valueFrame(t)});
+      waitFrame(1000000, [this, i, retry, done, startOfTransmission](const packet *p, int frameId, bool success) {
+        if (p != nullptr || frameId < 0 || !success || sim.now - startOfTransmission >= 20000)
+        {
+          retry();
+          return;
+        }
+        checkTimeOnUnit(i, 0, false, [this, retry, done](bool timeSetCorrectly) {
+          if (!timeSetCorrectly)
+          {
+            retry();
+            return;
+          }
+          delay(10000000, [this, done]() {
+            commandInFlight = false;
+            done();
+          });
+        });
+      });
+    });
+  }
+
+  //reads the time, the pressures and the sd status, ignoring frames of other units
+  void checkTimeOnUnit(size_t i, int received, bool timeSetCorrectly, std::function<void(bool)> done)
+  {
+    if (received == numChannels + 2)
+    {
+      done(timeSetCorrectly);
+      return;
+    }
+    waitFrame(1000000, [this, i, received, timeSetCorrectly, done](const packet *p, int, bool) {
+      if (p != nullptr && (p->source != address(i) || p->data.size() != 4))
+      {
+        checkTimeOnUnit(i, received, timeSetCorrectly, done);
+        return;
+      }
+      bool correct = timeSetCorrectly;
+      if (p != nullptr && received == 0)
+        correct = decodeUint32(p->data.data()) == sim.now / 1000000;
+      checkTimeOnUnit(i, received + 1, correct, done);
+    });
+  }
+
+  //nodes::configure(): blocking get of a parameter, polls pause meanwhile
+  void configure(size_t i)
+  {
+    if (commandInFlight)
+      return;
+    commandInFlight = true;
+    int64_t start = sim.now;
+    std::vector<uint8_t> frame(configFrameLength);
+    encodeConfigFrame(frame.data(), configGet | paramOutputInterval, 0);
+    xbee.send(packet{0, address(i), 1, frame});
+    waitConfigReply(i, start);
+  }
+
+  void waitConfigReply(size_t i, int64_t start)
+  {
+    int64_t remaining = 1000000 - (sim.now - start);
+    if (remaining <= 0)
+    {
+      commandsFailed++;
+      commandInFlight = false;
+      return;
+    }
+    waitFrame(remaining, [this, i, start](const packet *p, int, bool) {
+      if (p != nullptr && p->source == address(i) && p->data.size() == configFrameLength && p->data[0] == configMarker)
+      {
+        commandLatency.add((sim.now - start) / 1000.0);
+        commandInFlight = false;
+        return;
+      }
+      if (p == nullptr && sim.now - start >= 1000000)
+      {
+        commandsFailed++;
+        commandInFlight = false;
+        return;
+      }
+      waitConfigReply(i, start);
+    });
+  }
+
+  void poll()
+  {
+    if (!commandInFlight)
+    {
+      size_t i = pollIndex;
+      pollSequence[i]++;
+      pollSent[i] = sim.now;
+      if (measuring)
+      {
+        pollsSent++;
+        //includes the polls skipped while a command was in flight
+        if (lastPolled[i] != 0)
+          pollCycle.add((sim.now - lastPolled[i]) / 1e6);
+      }
+      lastPolled[i] = sim.now;
+      std::vector<uint8_t> frame = {statusMarker, pollSequence[i]};
+      xbee.send(packet{0, address(i), 0, frame});
+      pollIndex = (pollIndex + 1) % units.size();
+    }
+    sim.after(100000, [this]() { poll(); });
+  }
+};
+
+struct result
+{
+  size_t numUnits;
+  double startSeconds;
+  int startFailures;
+  int startRetries;
+  statistics syncError;
+  double pollGoodput;
+  double pollAnswered;
+  statistics pollCycle;
+  statistics pollRoundTrip;
+  statistics commandLatency;
+  uint64_t commandsFailed;
+  double utilization;
+};
+
+static result runFleet(size_t numUnits, int64_t seconds, double loss, bool uiDelays, uint64_t seed)
+{
+  simulation sim;
+  sim.random.seed(seed);
+  sim.loss = loss;
+  sim.now = 1700000000LL * 1000000; //rtc of the coordinator, set from gps
+  channel air(sim);
+  std::vector<std::unique_ptr<edgeModel>> units;
+  for (size_t i = 0; i < numUnits; i++)
+    units.emplace_back(new edgeModel(sim, air, 0x00E0 + i));
+  coordinatorModel coordinator(sim, air, units, uiDelays);
+
+  result r = {};
+  r.numUnits = numUnits;
+  int64_t begin = sim.now;
+  bool started = false;
+  coordinator.startFleet(0, [&]() { started = true; });
+  coordinator.poll();
+  while (!started)
+    sim.run(sim.now + 1000000);
+  r.startSeconds = (coordinator.fleetStarted - begin) / 1e6;
+  r.startFailures = coordinator.startFailures;
+  r.startRetries = coordinator.startRetries;
+  for (auto &u : units)
+  {
+    if (u->synced)
+      r.syncError.add(u->syncError / 1000.0);
+  }
+
+  //steady state: polls and a configuration command every 2 s on average, at random times
+  //so commands overlap the polls at every phase
+  coordinator.measuring = true;
+  int64_t measureStart = sim.now;
+  int64_t airtimeStart = sim.busyAirtime;
+  std::function<void()> command = [&]() {
+    coordinator.configure(sim.uniform(0, numUnits - 1));
+    sim.after(sim.uniform(1000000, 3000000), command);
+  };
+  sim.after(sim.uniform(0, 2000000), command);
+  sim.run(sim.now + seconds * 1000000);
+  double measured = (sim.now - measureStart) / 1e6;
+  r.pollGoodput = coordinator.pollReplies * statusReplyLength / measured;
+  r.pollAnswered = coordinator.pollsSent ? 100.0 * coordinator.pollReplies / coordinator.pollsSent : 0;
+  r.pollCycle = coordinator.pollCycle;
+  r.pollRoundTrip = coordinator.pollRoundTrip;
+  r.commandLatency = coordinator.commandLatency;
+  r.commandsFailed = coordinator.commandsFailed;
+  r.utilization = 100.0 * (sim.busyAirtime - airtimeStart) / (measured * 1e6);
+  return r;
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<size_t> fleetSizes = {8, 16, 32, 64, 128};
+  int64_t seconds = 60;
+  double loss = 0.01;
+  bool uiDelays = true;
+  uint64_t seed = 1;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--units") == 0 && i + 1 < argc)
+    {
+      fleetSizes.clear();
+      for (char *s = strtok(argv[++i], ","); s != nullptr; s = strtok(nullptr, ","))
+        fleetSizes.push_back(strtoul(s, nullptr, 10));
+    }
+    else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+      seconds = atol(argv[++i]);
+    else if (strcmp(argv[i], "--loss") == 0 && i + 1 < argc)
+      loss = atof(argv[++i]);
+    else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+      seed = strtoull(argv[++i], nullptr, 10);
+    else if (strcmp(argv[i], "--no-ui-delays") == 0)
+      uiDelays = false;
+    else
+    {
+      fprintf(stderr, "usage: %s [--units 8,16,32] [--seconds 60] [--loss 0.01] [--no-ui-delays] [--seed 1]\n", argv[0]);
+      return 1;
+    }
+  }
+  printf("%5s | %9s %5s %5s | %21s | %9s %6s %15s %15s | %23s %5s | %5s\n", "units", "start s", "fail", "retry",
+         "sync ms p50/p95/max", "poll B/s", "ans %", "cycle s p50/max", "rtt ms p50/p95", "command ms p50/p95/p99", "fail", "air %");
+  for (size_t n : fleetSizes)
+  {
+    if (n == 0 || n > 0xFF00 - 0x00E0)
+      continue;
+    result r = runFleet(n, seconds, loss, uiDelays, seed);
+    printf("%5zu | %9.1f %5d %5d | %6.2f %6.2f %7.2f | %9.1f %6.1f %7.2f %7.2f %7.2f %7.2f | %7.1f %7.1f %7.1f %5llu | %5.2f\n",
+           r.numUnits, r.startSeconds, r.startFailures, r.startRetries, r.syncError.percentile(0.5), r.syncError.percentile(0.95),
+           r.syncError.percentile(1.0), r.pollGoodput, r.pollAnswered, r.pollCycle.percentile(0.5), r.pollCycle.percentile(1.0),
+           r.pollRoundTrip.percentile(0.5),
+           r.pollRoundTrip.percentile(0.95), r.commandLatency.percentile(0.5), r.commandLatency.percentile(0.95),
+           r.commandLatency.percentile(0.99), (unsigned long long)r.commandsFailed, r.utilization);
+  }
+  return 0;
+}
@@ -0,0 +1,475 @@
+// Measures how pressure waves travel from the pump room to the deluge valves.
+//
+//   waveanalysis [options] <from> <to> <unit directory>:<metres>[:<upstream>] ...
+//
+// Every unit is the card contents of one edge (see logquery.cpp), the first one
+// is the reference, normally the pump room. metres is the pipe length from the
+// reference to the unit and upstream the number of the unit the pipe comes
+// from, 0 (the reference) by default, so a branched network is described as
+// a tree of pipe segments.
+//
+// Events are pressure drops of the reference: the reading falls by more than
+// --threshold counts within --rise seconds. For every event a window of --pre
+// seconds before and --post seconds after it is resampled from the logs of
+// every unit, and the arrival delay of each unit behind the reference is the
+// peak of the cross correlation of the pressure derivatives, computed with an
+// FFT and refined to a fraction of a sample. The drop of every unit gives the
+// attenuation. The report has the delay and drop of every unit per event
+// (--events) and, for every pipe segment, the median propagation speed and
+// attenuation over the events.
+//
+// Detection runs on chunks of the range and the event windows are analysed on
+// all cores, the logs are mapped once and read through their time indexes.
+// wavetest.cpp checks the speeds and attenuations on a synthetic hour.
+//
+//   --channel <n>      channel of the units to analyse, default 0
+//   --rate <hz>        resampling rate, default 100
+//   --threshold <n>    drop in counts that makes an event, default 50
+//   --rise <s>         time the drop has to happen in, default 0.5
+//   --pre <s> --post <s>  window around an event, default 2 and 8
+//   --max-delay <s>    largest delay searched for, default 2
+//   --min-corr <c>     correlation below which a unit is ignored, default 0.5
+//   --threads <n>      default all cores
+//   --events           print every event
+//
+// build: g++ -O3 -march=native -std=c++17 -pthread -I.. -o waveanalysis waveanalysis.cpp
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <ctime>
+#include <thread>
+
+#include "edgelog.h"
+
+struct unit
+{
+  std::string directory;
+  double metres = 0;
+  int upstream = 0;
+  std::vector<edgeLog> logs;
+};
+
+struct options
+{
+  int channel = 0;
+  double rate = 100;
+  double threshold = 50;
+  double rise = 0.5;
+  double pre = 2;
+  double post = 8;
+  double maxDelay = 2;
+  double minCorrelation = 0.5;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  bool printEvents = false;
+};
+
+static options opt;
+static std::vector<unit> units;
+
+//resamples the channel of a unit onto n points every stepMicros from t0 by linear
+//interpolation, points in gaps of more than maxGapMicros are NaN. returns the number
+//of valid points
+static size_t resample(const unit &u, uint64_t t0, size_t n, double stepMicros, float *out)
+{
+  const double maxGapMicros = 2e6;
+  std::fill(out, out + n, NAN);
+  uint64_t from = t0 > maxGapMicros ? t0 - maxGapMicros : 0;
+  uint64_t to = t0 + (uint64_t)(n * stepMicros + maxGapMicros);
+  size_t next = 0, valid = 0;
+  bool havePrevious = false;
+  uint64_t previousMicros = 0;
+  float previousValue = 0;
+  for (const edgeLog &l : u.logs)
+  {
+    if (next >= n)
+      break;
+    //a log ends where the next one starts, logs outside the range are not touched
+    if ((uint64_t)l.startTime * 1000000 >= to)
+      break;
+    if (&l != &u.logs.back() && (uint64_t)(&l)[1].startTime * 1000000 <= from)
+      continue;
+    int column = l.column(opt.channel);
+    if (column < 0)
+      continue;
+    l.query(from, to, [&](const edgeRecord &r) {
+      if (r.numValues <= column)
+        return true;
+      float value = r.values[column];
+      for (; next < n && t0 + next * stepMicros < r.micros; next++)
+      {
+        double t = t0 + next * stepMicros;
+        if (havePrevious && t >= previousMicros && r.micros - previousMicros <= maxGapMicros)
+        {
+          out[next] = previousValue + (value - previousValue) * (float)((t - previousMicros) / (r.micros - previousMicros));
+          valid++;
+        }
+      }
+      previousMicros = r.micros;
+      previousValue = value;
+      havePrevious = true;
+      return next < n;
+    });
+  }
+  return valid;
+}
+
+//in place radix 2 FFT on split real and imaginary arrays. The butterflies of a stage
+//run over contiguous data with their own twiddle table, so the inner loop vectorizes
+class fft
+{
+  public:
+  size_t size;
+  std::vector<uint32_t> reversed;
+  std::vector<float> twiddleRe, twiddleIm; //stage after stage, half entries each
+
+  explicit fft(size_t n) : size(n), reversed(n)
+  {
+    int bits = 0;
+    while (((size_t)1 << bits) < n)
+      bits++;
+    for (size_t i = 0; i < n; i++)
+    {
+      uint32_t r = 0;
+      for (int b = 0; b < bits; b++)
+        r |= ((i >> b) & 1) << (bits - 1 - b);
+      reversed[i] = r;
+    }
+    for (size_t half = 1; half < n; half *= 2)
+    {
+      for (size_t j = 0; j < half; j++)
+      {
+        double angle = -M_PI * j / half;
+        twiddleRe.push_back(cos(angle));
+        twiddleIm.push_back(sin(angle));
+      }
+    }
+  }
+
+  void forward(float *__restrict re, float *__restrict im) const
+  {
+    for (size_t i = 0; i < size; i++)
+    {
+      if (i < reversed[i])
+      {
+        std::swap(re[i], re[reversed[i]]);
+        std::swap(im[i], im[reversed[i]]);
+      }
+    }
+    size_t offset = 0;
+    for (size_t half = 1; half < size; offset += half, half *= 2)
+    {
+      const float *wr = &twiddleRe[offset], *wi = &twiddleIm[offset];
+      for (size_t start = 0; start < size; start += 2 * half)
+      {
+        float *__restrict ar = re + start, *__restrict ai = im + start;
+        float *__restrict br = ar + half, *__restrict bi = ai + half;
+        for (size_t j = 0; j < half; j++)
+        {
+          float tr = br[j] * wr[j] - bi[j] * wi[j];
+          float ti = br[j] * wi[j] + bi[j] * wr[j];
+          br[j] = ar[j] - tr;
+          bi[j] = ai[j] - ti;
+          ar[j] += tr;
+          ai[j] += ti;
+        }
+      }
+    }
+  }
+
+  //unscaled inverse, the forward transform with real and imaginary parts swapped
+  void inverse(float *re, float *im) const { forward(im, re); }
+};
+
+//delay of b behind a by cross correlation, one per thread with its buffers
+class correlator
+{
+  public:
+  size_t length;
+  fft transform;
+  std::vector<float> aRe, aIm, bRe, bIm;
+
+  static size_t paddedSize(size_t n)
+  {
+    size_t size = 1;
+    while (size < 2 * n)
+      size *= 2;
+    return size;
+  }
+
+  explicit correlator(size_t n)
+      : length(n), transform(paddedSize(n)), aRe(transform.size), aIm(transform.size), bRe(transform.size), bIm(transform.size)
+  {
+  }
+
+  //loads the derivative of x without its mean, returns its energy
+  static double load(const float *x, size_t n, float *re, float *im, size_t size)
+  {
+    double mean = (x[n - 1] - x[0]) / (double)(n - 1);
+    double energy = 0;
+    for (size_t i = 0; i + 1 < n; i++)
+    {
+      re[i] = x[i + 1] - x[i] - mean;
+      energy += (double)re[i] * re[i];
+    }
+    std::fill(re + n - 1, re + size, 0.0f);
+    std::fill(im, im + size, 0.0f);
+    return energy;
+  }
+
+  //lag of b behind a in samples, within maxLag, and the correlation coefficient at the peak
+  bool delay(const float *a, const float *b, int maxLag, double &lag, double &coefficient)
+  {
+    size_t size = transform.size;
+    double energyA = load(a, length, aRe.data(), aIm.data(), size);
+    double energyB = load(b, length, bRe.data(), bIm.data(), size);
+    if (energyA <= 0 || energyB <= 0)
+      return false;
+    transform.forward(aRe.data(), aIm.data());
+    transform.forward(bRe.data(), bIm.data());
+    //conj(A) * B, its inverse is sum a[t] b[t + lag]
+    for (size_t i = 0; i < size; i++)
+    {
+      float re = aRe[i] * bRe[i] + aIm[i] * bIm[i];
+      float im = aRe[i] * bIm[i] - aIm[i] * bRe[i];
+      bRe[i] = re;
+      bIm[i] = im;
+    }
+    transform.inverse(bRe.data(), bIm.data());
+    auto at = [&](int l) { return bRe[(l + size) % size]; };
+    maxLag = std::min<int>(maxLag, length - 2);
+    int best = -maxLag;
+    for (int l = -maxLag; l <= maxLag; l++)
+    {
+      if (at(l) > at(best))
+        best = l;
+    }
+    lag = best;
+    if (best > -maxLag && best < maxLag)
+    {
+      double y0 = at(best - 1), y1 = at(best), y2 = at(best + 1);
+      double curvature = y0 - 2 * y1 + y2;
+      if (curvature < 0)
+        lag += 0.5 * (y0 - y2) / curvature;
+    }
+    coefficient = at(best) / size / sqrt(energyA * energyB);
+    return true;
+  }
+};
+
+//runs job(i, worker) for i in [0, n) on all threads
+template <class F>
+static void parallelFor(size_t n, F job)
+{
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  for (unsigned w = 0; w < opt.threads; w++)
+  {
+    workers.emplace_back([&, w]() {
+      for (size_t i; (i = next++) < n;)
+        job(i, w);
+    });
+  }
+  for (std::thread &t : workers)
+    t.join();
+}
+
+//drops of the reference by more than the threshold within the rise time
+static std::vector<uint64_t> detectEvents(uint64_t from, uint64_t to)
+{
+  const double stepMicros = 1e6 / opt.rate;
+  const size_t rise = std::max<size_t>(1, opt.rise * opt.rate);
+  const uint64_t chunkMicros = 3600ull * 1000000;
+  size_t numChunks = (to - from + chunkMicros - 1) / chunkMicros;
+  std::vector<std::vector<uint64_t>> found(numChunks);
+  parallelFor(numChunks, [&](size_t c, unsigned) {
+    uint64_t start = from + c * chunkMicros;
+    //starts the rise time early so a drop across the chunk border is seen
+    uint64_t t0 = start - std::min<uint64_t>(start - from, rise * stepMicros);
+    size_t n = (std::min(to, start + chunkMicros) - t0) / stepMicros;
+    std::vector<float> x(n);
+    if (resample(units[0], t0, n, stepMicros, x.data()) == 0)
+      return;
+    for (size_t i = rise; i < n; i++)
+    {
+      if (x[i - rise] - x[i] >= opt.threshold)
+      {
+        //the event is where the fall starts to stand out of the noise
+        size_t s = i;
+        while (s > i - rise && x[i - rise] - x[s - 1] >= opt.threshold / 4)
+          s--;
+        uint64_t t = t0 + (uint64_t)(s * stepMicros);
+        if (t >= start)
+          found[c].push_back(t);
+        i += opt.post * opt.rate;
+      }
+    }
+  });
+  //an event of a chunk can be the tail of one at the end of the previous chunk
+  std::vector<uint64_t> events;
+  for (const std::vector<uint64_t> &chunk : found)
+  {
+    for (uint64_t t : chunk)
+    {
+      if (events.empty() || t - events.back() >= opt.post * 1e6)
+        events.push_back(t);
+    }
+  }
+  return events;
+}
+
+struct arrival
+{
+  bool valid = false;
+  double delay = 0; //seconds behind the reference
+  double correlation = 0;
+  double drop = 0;  //counts from the level before the event to the lowest after it
+};
+
+static double dropOf(const float *x, size_t preSamples, size_t n)
+{
+  double baseline = 0;
+  for (size_t i = 0; i < preSamples; i++)
+    baseline += x[i];
+  baseline /= preSamples;
+  float lowest = *std::min_element(x + preSamples, x + n);
+  return baseline - lowest;
+}
+
+int main(int argc, char **argv)
+{
+  int i = 1;
+  for (; i < argc && strncmp(argv[i], "--", 2) == 0; i++)
+  {
+    if (strcmp(argv[i], "--events") == 0)
+      opt.printEvents = true;
+    else if (i + 1 >= argc)
+      break;
+    else if (strcmp(argv[i], "--channel") == 0)
+      opt.channel = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--rate") == 0)
+      opt.rate = atof(argv[++i]);
+    else if (strcmp(argv[i], "--threshold") == 0)
+      opt.threshold = atof(argv[++i]);
+    else if (strcmp(argv[i], "--rise") == 0)
+      opt.rise = atof(argv[++i]);
+    else if (strcmp(argv[i], "--pre") == 0)
+      opt.pre = atof(argv[++i]);
+    else if (strcmp(argv[i], "--post") == 0)
+      opt.post = atof(argv[++i]);
+    else if (strcmp(argv[i], "--max-delay") == 0)
+      opt.maxDelay = atof(argv[++i]);
+    else if (strcmp(argv[i], "--min-corr") == 0)
+      opt.minCorrelation = atof(argv[++i]);
+    else if (strcmp(argv[i], "--threads") == 0)
+      opt.threads = std::max(1, atoi(argv[++i]));
+    else
+      break;
+  }
+  uint64_t from, to;
+  if (argc - i < 4 || strncmp(argv[i], "--", 2) == 0 || !parseTime(argv[i], from) || !parseTime(argv[i + 1], to) || to <= from ||
+      opt.rate <= 0 || opt.pre <= 0 || opt.post <= 0 || opt.channel < 0 || opt.channel >= maxLogChannels)
+  {
+    fprintf(stderr, "usage: %s [options] <from> <to> <unit directory>:<metres>[:<upstream>] ...\n", argv[0]);
+    return 1;
+  }
+  for (i += 2; i < argc; i++)
+  {
+    unit u;
+    std::string spec = argv[i];
+    size_t colon = spec.find(':');
+    u.directory = spec.substr(0, colon);
+    if (colon != std::string::npos)
+    {
+      char *end;
+      u.metres = strtod(spec.c_str() + colon + 1, &end);
+      if (*end == ':')
+        u.upstream = atoi(end + 1);
+    }
+    if (!units.empty() && (u.upstream < 0 || u.upstream >= (int)units.size()))
+    {
+      fprintf(stderr, "%s: the upstream unit has to be listed before it\n", argv[i]);
+      return 1;
+    }
+    u.logs = findLogs(u.directory);
+    for (edgeLog &l : u.logs)
+    {
+      if (!l.open())
+        perror(l.logPath.c_str());
+    }
+    if (u.logs.empty())
+      fprintf(stderr, "%s: no logs found\n", u.directory.c_str());
+    units.push_back(std::move(u));
+  }
+
+  auto started = std::chrono::steady_clock::now();
+  std::vector<uint64_t> events = detectEvents(from, to);
+
+  const double stepMicros = 1e6 / opt.rate;
+  const size_t preSamples = opt.pre * opt.rate;
+  const size_t n = preSamples + (size_t)(opt.post * opt.rate);
+  const int maxLag = opt.maxDelay * opt.rate;
+  std::vector<arrival> arrivals(events.size() * units.size());
+  std::vector<correlator> correlators(opt.threads, correlator(n));
+  parallelFor(events.size(), [&](size_t e, unsigned worker) {
+    uint64_t t0 = events[e] - (uint64_t)(preSamples * stepMicros);
+    std::vector<float> reference(n), x(n);
+    if (resample(units[0], t0, n, stepMicros, reference.data()) < n)
+      return;
+    arrival *a = &arrivals[e * units.size()];
+    a[0] = {true, 0, 1, dropOf(reference.data(), preSamples, n)};
+    for (size_t u = 1; u < units.size(); u++)
+    {
+      double lag, coefficient;
+      if (resample(units[u], t0, n, stepMicros, x.data()) < n ||
+          !correlators[worker].delay(reference.data(), x.data(), maxLag, lag, coefficient))
+        continue;
+      a[u] = {coefficient >= opt.minCorrelation, lag / opt.rate, coefficient, dropOf(x.data(), preSamples, n)};
+    }
+  });
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+  if (opt.printEvents)
+  {
+    for (size_t e = 0; e < events.size(); e++)
+    {
+      printf("event %" PRIu64 ".%06" PRIu64 "\n", events[e] / 1000000, events[e] % 1000000);
+      for (size_t u = 0; u < units.size(); u++)
+      {
+        const arrival &a = arrivals[e * units.size() + u];
+        if (a.correlation == 0)
+          printf("  %-24s no data\n", units[u].directory.c_str());
+        else
+          printf("  %-24s delay %8.2f ms  corr %5.2f  drop %7.1f%s\n", units[u].directory.c_str(), a.delay * 1e3, a.correlation,
+                 a.drop, a.valid ? "" : "  (ignored)");
+      }
+    }
+  }
+
+  printf("%zu events\n", events.size());
+  printf("%-24s %-24s %8s %7s %22s %16s %10s\n", "from", "to", "metres", "events", "speed m/s (p10-p90)", "attenuation dB", "dB/km");
+  for (size_t u = 1; u < units.size(); u++)
+  {
+    const unit &down = units[u], &up = units[down.upstream];
+    double metres = down.metres - up.metres;
+    std::vector<double> speeds, decibels;
+    for (size_t e = 0; e < events.size(); e++)
+    {
+      const arrival &a = arrivals[e * units.size() + down.upstream], &b = arrivals[e * units.size() + u];
+      if (!a.valid || !b.valid)
+        continue;
+      if (b.delay > a.delay)
+        speeds.push_back(metres / (b.delay - a.delay));
+      if (a.drop > 0 && b.drop > 0)
+        decibels.push_back(20 * log10(a.drop / b.drop));
+    }
+    double attenuation = percentile(decibels, 0.5, NAN);
+    printf("%-24s %-24s %8.1f %7zu %8.1f (%5.1f-%6.1f) %16.2f %10.2f\n", up.directory.c_str(), down.directory.c_str(), metres,
+           speeds.size(), percentile(speeds, 0.5, NAN), percentile(speeds, 0.1, NAN), percentile(speeds, 0.9, NAN), attenuation,
+           metres > 0 ? attenuation / metres * 1e3 : NAN);
+  }
+  fprintf(stderr, "%.1f hours of %zu units analysed in %.2f s on %u threads\n", (to - from) / 3.6e9, units.size(), elapsed,
+          opt.threads);
+  return 0;
+}
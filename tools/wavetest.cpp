@@ -0,0 +1,255 @@
+// Checks the propagation speed and attenuation waveanalysis measures on a synthetic hour.
+//
+//   wavetest <waveanalysis> [seed]
+//
+// Writes the logs of three units to a temporary directory, the way writeData()
+// journals them: the reference at 0 m, a unit 300 m down the pipe and one 400 m
+// further. A pressure drop of the pump every three to six minutes travels at
+// 1000 m/s and loses 10 % of its height on the first segment and 12.5 % more on
+// the second. Records are written every 50 ms with 0.5 ms of jitter on their
+// capture time and 2 counts of noise. waveanalysis is then run on the hour and
+// has to find every drop, each segment within 1 % of 1000 m/s and within 0.3 dB
+// of its attenuation. Exits with 1 and keeps the logs when it does not.
+//
+// build: g++ -O2 -std=c++17 -I.. -o wavetest wavetest.cpp
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#define FILE_READ 0
+#define FILE_WRITE 1
+
+#include "journal.h"
+
+//the part of the File of the SD library the journal writes through
+class hostFile
+{
+  public:
+  FILE *f = nullptr;
+
+  explicit operator bool() const { return f != nullptr; }
+  size_t write(const uint8_t *p, size_t n) { return fwrite(p, 1, n, f); }
+  int read(void *p, size_t n) { return fread(p, 1, n, f); }
+  bool seek(uint64_t p) { return fseeko(f, p, SEEK_SET) == 0; }
+
+  uint64_t size()
+  {
+    struct stat st;
+    fflush(f);
+    return fstat(fileno(f), &st) == 0 ? st.st_size : 0;
+  }
+
+  bool truncate(uint64_t length)
+  {
+    fflush(f);
+    return ftruncate(fileno(f), length) == 0;
+  }
+
+  void flush() { fflush(f); }
+
+  void close()
+  {
+    if (f != nullptr)
+      fclose(f);
+    f = nullptr;
+  }
+};
+
+//a directory on the host in place of the card
+class hostCard
+{
+  public:
+  std::string root;
+
+  hostFile open(const char *name, uint8_t mode = FILE_READ)
+  {
+    hostFile file;
+    file.f = fopen((root + "/" + name).c_str(), mode == FILE_WRITE ? "ab" : "rb");
+    return file;
+  }
+
+  bool remove(const char *name) { return ::remove((root + "/" + name).c_str()) == 0; }
+};
+
+static const uint32_t startTime = 1760868000; //2025-10-19 10:00:00 UTC
+static const uint32_t hourSeconds = 3600;
+static const double speed = 1000;             //m/s
+static const double baseline = 2000;          //counts before a drop
+static const double dropHeight = 300;         //counts at the reference
+static const double fallSeconds = 0.1;        //time constant of the drop
+static const double holdSeconds = 30;         //the pressure recovers after this
+static const uint32_t outputMicros = 50000;
+
+struct unitSpec
+{
+  const char *name;
+  double metres;
+  int upstream;
+  double height; //fraction of the drop of the reference that arrives
+};
+
+static const unitSpec specs[] = {{"pump", 0, 0, 1.0}, {"valve1", 300, 0, 0.9}, {"valve2", 700, 1, 0.8}};
+static const int numUnits = sizeof(specs) / sizeof(specs[0]);
+
+static uint64_t now = 0;
+
+static uint32_t fakeMillis()
+{
+  return now / 1000;
+}
+
+//pressure of a unit at t: every drop falls with fallSeconds and recovers after holdSeconds
+static double pressureAt(const unitSpec &u, const std::vector<double> &drops, double t)
+{
+  double p = baseline;
+  for (double d : drops)
+  {
+    double arrival = d + u.metres / speed;
+    if (t > arrival)
+      p -= dropHeight * u.height * (1 - exp(-(t - arrival) / fallSeconds));
+    if (t > arrival + holdSeconds)
+      p += dropHeight * u.height * (1 - exp(-(t - arrival - holdSeconds) / fallSeconds));
+  }
+  return p;
+}
+
+//writes the log and index of one unit as writeData() and openLogFiles() do
+static bool writeUnit(const std::string &root, const unitSpec &u, const std::vector<double> &drops, std::mt19937 &random)
+{
+  time_t start = startTime;
+  tm t;
+  gmtime_r(&start, &t);
+  fmtLine<32> name;
+  name.addPadded(t.tm_year + 1900, 4).addPadded(t.tm_mon + 1, 2);
+  std::error_code ec;
+  std::filesystem::create_directories(root + "/" + name.text(), ec);
+  name.addChar('/').addPadded(t.tm_mday, 2).addPadded(t.tm_hour, 2).addPadded(t.tm_min, 2).addPadded(t.tm_sec, 2);
+  std::string base = name.text();
+  hostCard card{root};
+  journal<hostFile, hostCard> log(card, fakeMillis, nullptr);
+  if (!log.open((base + ".CSV").c_str()) || !log.openIndex((base + ".IDX").c_str(), startTime, 1))
+    return false;
+  fmtLine<96> header;
+  header.addText("#H,").addUnsigned(startTime).addText(",2,50,1,12,").addHex(1).addText(",0,1000\n");
+  log.append(header.data, header.length);
+
+  std::normal_distribution<double> noise(0, 2);
+  std::uniform_int_distribution<int> jitter(-500, 500);
+  uint64_t previousRecordMicros = 0;
+  for (uint64_t slot = (uint64_t)startTime * 1000000 + outputMicros; slot < (uint64_t)(startTime + hourSeconds) * 1000000; slot += outputMicros)
+  {
+    uint64_t captureTime = slot + jitter(random);
+    now = captureTime - (uint64_t)startTime * 1000000;
+    double value = pressureAt(u, drops, (captureTime - (uint64_t)startTime * 1000000) / 1e6) + noise(random);
+    fmtLine<64> record;
+    log.reserve(sizeof(record.data));
+    if (!log.anchored)
+    {
+      record.addText("#T,").addUnsigned(captureTime / 1000000).addChar(',').addPadded(captureTime % 1000000, 6).addChar('\n');
+      previousRecordMicros = captureTime;
+      log.anchored = true;
+      log.anchorSeconds = captureTime / 1000000;
+      log.anchorMicros = captureTime % 1000000;
+    }
+    record.addUnsigned(captureTime - previousRecordMicros);
+    previousRecordMicros = captureTime;
+    record.addText(" , ").addUnsigned(lround(value)).addChar('\n');
+    if (!log.append(record.data, record.length))
+      return false;
+  }
+  log.close();
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s <waveanalysis> [seed]\n", argv[0]);
+    return 1;
+  }
+  uint32_t seed = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1;
+  std::mt19937 random(seed);
+
+  //drops every 3 to 6 minutes, the last one leaves room for the analysis window
+  std::vector<double> drops;
+  std::uniform_real_distribution<double> interval(180, 360);
+  for (double t = 60 + interval(random) / 3; t < hourSeconds - 60; t += interval(random))
+    drops.push_back(t);
+
+  char pattern[] = "/tmp/wavetestXXXXXX";
+  if (mkdtemp(pattern) == nullptr)
+  {
+    perror("mkdtemp");
+    return 1;
+  }
+  std::string root = pattern;
+  std::string command = std::string(argv[1]) + " " + std::to_string(startTime) + " " + std::to_string(startTime + hourSeconds);
+  for (const unitSpec &u : specs)
+  {
+    std::string directory = root + "/" + u.name;
+    std::filesystem::create_directories(directory);
+    if (!writeUnit(directory, u, drops, random))
+    {
+      fprintf(stderr, "%s: the logs could not be written\n", directory.c_str());
+      return 1;
+    }
+    command += " " + directory + ":" + std::to_string((int)u.metres) + ":" + std::to_string(u.upstream);
+  }
+
+  FILE *out = popen(command.c_str(), "r");
+  if (out == nullptr)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+  //"<n> events", a header and a row per segment
+  char line[256];
+  size_t numEvents = 0;
+  int numSegments = 0;
+  bool passed = true;
+  while (fgets(line, sizeof(line), out) != nullptr)
+  {
+    fputs(line, stdout);
+    double metres, measured, attenuation;
+    size_t events;
+    if (sscanf(line, "%zu events", &events) == 1)
+    {
+      numEvents = events;
+      continue;
+    }
+    if (sscanf(line, "%*s %*s %lf %zu %lf (%*f-%*f) %lf", &metres, &events, &measured, &attenuation) != 4)
+      continue;
+    numSegments++;
+    const unitSpec &down = specs[numSegments], &up = specs[down.upstream];
+    double expected = 20 * log10(up.height / down.height);
+    if (metres != down.metres - up.metres || events != drops.size() || fabs(measured - speed) > 0.01 * speed || fabs(attenuation - expected) > 0.3)
+    {
+      fprintf(stderr, "segment %s-%s: %zu events at %.1f m/s and %.2f dB, expected %zu at %.0f m/s and %.2f dB\n", up.name,
+              down.name, events, measured, attenuation, drops.size(), speed, expected);
+      passed = false;
+    }
+  }
+  if (pclose(out) != 0 || numSegments != numUnits - 1 || numEvents != drops.size())
+  {
+    fprintf(stderr, "waveanalysis found %zu of %zu drops on %d of %d segments\n", numEvents, drops.size(), numSegments,
+            numUnits - 1);
+    passed = false;
+  }
+  if (!passed)
+  {
+    fprintf(stderr, "seed %u: logs kept in %s\n", seed, root.c_str());
+    return 1;
+  }
+  std::filesystem::remove_all(root);
+  printf("%zu drops within 1 %% of %.0f m/s\n", drops.size(), speed);
+  return 0;
+}
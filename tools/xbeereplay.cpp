@@ -0,0 +1,315 @@
+// Replays a .XBT trace written by the coordinator or an edge unit.
+//
+//   xbeereplay dump <trace.XBT>
+//   xbeereplay replay <trace.XBT> <serial port> [speed]
+//
+// replay feeds every received frame of the trace, as escaped API frames
+// (AP=2), into the serial port at the recorded times divided by speed
+// (0 = as fast as possible). The port is wired to the UART of a bench unit
+// in place of its XBee, so the firmware sees the recorded session. Frames the
+// firmware sends back are compared in order with the frames it sent in the
+// recording, and the run ends with throughput and response time statistics.
+//
+// build: g++ -O2 -std=c++17 -I.. -o xbeereplay xbeereplay.cpp
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#define FILE_WRITE 1 //of SD.h, only used by traceWriter::begin on the unit
+
+#include "edgelog.h"
+#include "protocol.h"
+#include "xbeetrace.h"
+
+struct frame
+{
+  uint32_t micros;
+  uint8_t direction;
+  uint8_t apiId;
+  std::vector<uint8_t> body;
+};
+
+static bool readTrace(const char *path, traceHeader &header, std::vector<frame> &frames)
+{
+  FILE *f = fopen(path, "rb");
+  if (f == nullptr)
+  {
+    perror(path);
+    return false;
+  }
+  if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != traceMagic || header.version != traceVersion)
+  {
+    fprintf(stderr, "%s: not a trace file\n", path);
+    fclose(f);
+    return false;
+  }
+  traceRecordHeader record;
+  while (fread(&record, sizeof(record), 1, f) == 1)
+  {
+    frame fr = {record.micros, record.direction, record.apiId, std::vector<uint8_t>(record.length)};
+    if (fread(fr.body.data(), 1, record.length, f) != record.length)
+    {
+      fprintf(stderr, "%s: truncated record, %zu frames read\n", path, frames.size());
+      break;
+    }
+    frames.push_back(std::move(fr));
+  }
+  fclose(f);
+  return true;
+}
+
+static void dump(const traceHeader &header, const std::vector<frame> &frames)
+{
+  printf("unit 0x%04X, started at %u\n", header.address16, header.unixTime);
+  for (const frame &fr : frames)
+  {
+    //micros() wraps after 71 minutes, the unsigned difference stays correct across a wrap
+    printf("%12.6f %s api 0x%02X len %3zu:", (uint32_t)(fr.micros - header.micros) / 1e6,
+           fr.direction == traceSent ? "tx" : "rx", fr.apiId, fr.body.size());
+    for (uint8_t b : fr.body)
+      printf(" %02X", b);
+    printf("\n");
+  }
+}
+
+//bytes of a tx16 payload that follow from the request alone: the marker and the echoed
+//sequence of a status reply, the marker and command of a config reply and the marker,
+//period, first channel and channel count of a rollup reply. the 4 byte value frames of
+//the handshake carry times and pressures and are only compared by length
+static size_t stablePayloadBytes(const uint8_t *payload, size_t length)
+{
+  if (length == 4 || length == 0)
+    return 0;
+  switch (payload[0])
+  {
+    case statusMarker: return 2;
+    case configMarker: return 2;
+    case rollupMarker: return 4;
+  }
+  return length;
+}
+
+//compares a frame sent by the firmware with the recorded one, api id and body
+//in got. a tx16 request (api 0x01, body frame id, destination, options, payload)
+//must match in its header, payload length and stable payload bytes, any other
+//frame byte for byte
+static bool stableMatch(const frame &want, const std::vector<uint8_t> &got)
+{
+  if (got.empty() || want.apiId != got[0] || want.body.size() != got.size() - 1)
+    return false;
+  const uint8_t *body = got.data() + 1;
+  size_t compared = want.body.size();
+  if (want.apiId == 0x01 && compared >= 4)
+    compared = 4 + stablePayloadBytes(want.body.data() + 4, compared - 4);
+  return std::equal(want.body.begin(), want.body.begin() + compared, body);
+}
+
+static int openPort(const char *path)
+{
+  int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0)
+  {
+    perror(path);
+    return -1;
+  }
+  termios tio = {};
+  cfmakeraw(&tio);
+  cfsetispeed(&tio, B115200);
+  cfsetospeed(&tio, B115200);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tcsetattr(fd, TCSANOW, &tio);
+  tcflush(fd, TCIOFLUSH);
+  return fd;
+}
+
+static void putEscaped(std::vector<uint8_t> &out, uint8_t b)
+{
+  if (b == 0x7E || b == 0x7D || b == 0x11 || b == 0x13)
+  {
+    out.push_back(0x7D);
+    out.push_back(b ^ 0x20);
+  }
+  else
+  {
+    out.push_back(b);
+  }
+}
+
+static std::vector<uint8_t> encodeFrame(const frame &fr)
+{
+  std::vector<uint8_t> out = {0x7E};
+  uint16_t length = fr.body.size() + 1;
+  putEscaped(out, length >> 8);
+  putEscaped(out, length & 0xFF);
+  uint8_t sum = fr.apiId;
+  putEscaped(out, fr.apiId);
+  for (uint8_t b : fr.body)
+  {
+    sum += b;
+    putEscaped(out, b);
+  }
+  putEscaped(out, 0xFF - sum);
+  return out;
+}
+
+//unescapes the api frames the firmware writes to the port
+class frameParser
+{
+  public:
+  bool escaped = false;
+  int position = -1;
+  uint16_t length = 0;
+  std::vector<uint8_t> data;
+
+  //returns true when b completes a frame with a valid checksum, data then holds api id and body
+  bool put(uint8_t b)
+  {
+    if (b == 0x7E)
+    {
+      position = 0;
+      escaped = false;
+      data.clear();
+      return false;
+    }
+    if (position < 0)
+      return false;
+    if (b == 0x7D)
+    {
+      escaped = true;
+      return false;
+    }
+    if (escaped)
+    {
+      b ^= 0x20;
+      escaped = false;
+    }
+    if (position == 0)
+      length = b << 8;
+    else if (position == 1)
+      length |= b;
+    else if ((int)data.size() < length)
+      data.push_back(b);
+    else
+    {
+      position = -1;
+      uint8_t sum = b;
+      for (uint8_t d : data)
+        sum += d;
+      return sum == 0xFF && !data.empty();
+    }
+    position++;
+    return false;
+  }
+};
+
+static int replay(const traceHeader &header, const std::vector<frame> &frames, const char *port, double speed)
+{
+  int fd = openPort(port);
+  if (fd < 0)
+    return 1;
+  std::vector<const frame *> expected;
+  for (const frame &fr : frames)
+  {
+    if (fr.direction == traceSent)
+      expected.push_back(&fr);
+  }
+  using clock = std::chrono::steady_clock;
+  clock::time_point start = clock::now();
+  auto elapsedMicros = [&]() {
+    return std::chrono::duration<double, std::micro>(clock::now() - start).count();
+  };
+  frameParser parser;
+  size_t fed = 0, bytesFed = 0, received = 0, matched = 0;
+  double lastFedMicros = 0;
+  uint32_t lastFedRecorded = header.micros;
+  std::vector<double> responseMicros, recordedResponseMicros;
+  size_t next = 0;
+  //after the last fed frame, wait a little for the final answers of the firmware
+  double drainUntil = -1;
+  while (next < frames.size() || drainUntil < 0 || elapsedMicros() < drainUntil)
+  {
+    if (next == frames.size() && drainUntil < 0)
+      drainUntil = elapsedMicros() + 2e6;
+    if (next < frames.size())
+    {
+      const frame &fr = frames[next];
+      double due = speed > 0 ? (uint32_t)(fr.micros - header.micros) / speed : 0;
+      if (fr.direction == traceSent)
+      {
+        next++;
+        continue;
+      }
+      if (elapsedMicros() >= due)
+      {
+        std::vector<uint8_t> bytes = encodeFrame(fr);
+        if (write(fd, bytes.data(), bytes.size()) != (ssize_t)bytes.size())
+        {
+          perror(port);
+          close(fd);
+          return 1;
+        }
+        lastFedMicros = elapsedMicros();
+        lastFedRecorded = fr.micros;
+        bytesFed += bytes.size();
+        fed++;
+        next++;
+      }
+    }
+    uint8_t buffer[256];
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    for (ssize_t i = 0; i < n; i++)
+    {
+      if (!parser.put(buffer[i]))
+        continue;
+      responseMicros.push_back(elapsedMicros() - lastFedMicros);
+      if (received < expected.size())
+      {
+        const frame &want = *expected[received];
+        recordedResponseMicros.push_back((uint32_t)(want.micros - lastFedRecorded));
+        if (stableMatch(want, parser.data))
+          matched++;
+        else if (received - matched < 10)
+          printf("frame %zu differs from the recording (api 0x%02X, %zu bytes)\n", received, parser.data[0], parser.data.size() - 1);
+      }
+      received++;
+    }
+    if (n <= 0)
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  close(fd);
+  double seconds = std::max(lastFedMicros, 1.0) / 1e6;
+  printf("fed %zu frames (%zu bytes) in %.3f s, %.1f frames/s\n", fed, bytesFed, seconds, fed / seconds);
+  printf("firmware sent %zu frames, recording has %zu, %zu matching\n", received, expected.size(), matched);
+  printf("response after last fed frame (ms): p50 %.2f p95 %.2f max %.2f, recorded p50 %.2f p95 %.2f\n",
+         percentile(responseMicros, 0.5) / 1e3, percentile(responseMicros, 0.95) / 1e3, percentile(responseMicros, 1.0) / 1e3,
+         percentile(recordedResponseMicros, 0.5) / 1e3, percentile(recordedResponseMicros, 0.95) / 1e3);
+  return matched == expected.size() && received == expected.size() ? 0 : 2;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 3 || (strcmp(argv[1], "dump") != 0 && strcmp(argv[1], "replay") != 0) ||
+      (strcmp(argv[1], "replay") == 0 && argc < 4))
+  {
+    fprintf(stderr, "usage: %s dump <trace.XBT>\n       %s replay <trace.XBT> <serial port> [speed]\n", argv[0], argv[0]);
+    return 1;
+  }
+  traceHeader header;
+  std::vector<frame> frames;
+  if (!readTrace(argv[2], header, frames))
+    return 1;
+  if (strcmp(argv[1], "dump") == 0)
+  {
+    dump(header, frames);
+    return 0;
+  }
+  return replay(header, frames, argv[3], argc > 4 ? atof(argv[4]) : 1.0);
+}
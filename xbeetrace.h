@@ -0,0 +1,189 @@
+#ifndef XBEETRACE_H
+#define XBEETRACE_H
+
+#include <stdint.h>
+
+#include "fmt.h"
+
+// Raw XBee API frames tapped by the firmware, one trace file per session.
+// The file is a traceHeader followed by records: a traceRecordHeader and then
+// length bytes of the frame body, everything after the api id (for a sent
+// frame that is the frame id and the frame data). Little endian, as written
+// by the Teensy and read by tools/xbeereplay.cpp.
+//
+// Traces are kept next to the logs, YYYYMM/ddhhmmss.XBT. The sketches send and
+// read every frame through sendTraced() and readTraced() so nothing bypasses
+// the tap.
+
+static const uint32_t traceMagic = 0x52544258; //"XBTR"
+static const uint8_t traceVersion = 1;
+
+static const uint8_t traceReceived = 0; //delivered by the radio to the firmware
+static const uint8_t traceSent = 1;     //handed by the firmware to the radio
+
+struct traceHeader
+{
+  uint32_t magic;
+  uint8_t version;
+  uint8_t reserved;
+  uint16_t address16; //0 for the coordinator, 0xFFFF for an edge (its address is set in the radio)
+  uint32_t unixTime;  //rtc when the trace started
+  uint32_t micros;    //micros() when the trace started
+};
+
+struct traceRecordHeader
+{
+  uint32_t micros;
+  uint8_t direction;
+  uint8_t apiId;
+  uint8_t length;
+  uint8_t reserved;
+};
+
+static_assert(sizeof(traceHeader) == 16, "trace header layout");
+static_assert(sizeof(traceRecordHeader) == 8, "trace record layout");
+
+//days since 1970-01-01 to year, month and day of the gregorian calendar
+static inline void civilDate(uint32_t days, uint32_t &year, uint32_t &month, uint32_t &day)
+{
+  uint32_t z = days + 719468;
+  uint32_t era = z / 146097;
+  uint32_t dayOfEra = z - era * 146097;
+  uint32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+  uint32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+  uint32_t mp = (5 * dayOfYear + 2) / 153;
+  day = dayOfYear - (153 * mp + 2) / 5 + 1;
+  month = mp < 10 ? mp + 3 : mp - 9;
+  year = yearOfEra + era * 400 + (month <= 2);
+}
+
+//the month directory of a trace, YYYYMM
+template <uint16_t Capacity>
+void traceDirectory(fmtLine<Capacity> &name, uint32_t unixTime)
+{
+  uint32_t year, month, day;
+  civilDate(unixTime / 86400, year, month, day);
+  name.addPadded(year, 4).addPadded(month, 2);
+}
+
+//appends the file of a trace to its directory, /ddhhmmss.XBT
+template <uint16_t Capacity>
+void traceFileName(fmtLine<Capacity> &name, uint32_t unixTime)
+{
+  uint32_t year, month, day;
+  civilDate(unixTime / 86400, year, month, day);
+  uint32_t secondOfDay = unixTime % 86400;
+  name.addChar('/').addPadded(day, 2).addPadded(secondOfDay / 3600, 2).addPadded(secondOfDay / 60 % 60, 2);
+  name.addPadded(secondOfDay % 60, 2).addText(".XBT");
+}
+
+//writes trace records to a file type with write(const uint8_t *, size_t), flush() and close()
+template <class FileT>
+class traceWriter
+{
+  public:
+  static const uint32_t flushMicros = 1000000;
+  FileT file;
+  bool isOpen = false;
+  uint32_t lastFlushMicros = 0;
+
+  //begin(fs, ...) names the file, this takes one already open and empty
+  void begin(FileT f, uint16_t address16, uint32_t unixTime, uint32_t now)
+  {
+    end();
+    file = f;
+    traceHeader header = {traceMagic, traceVersion, 0, address16, unixTime, now};
+    file.write((const uint8_t *)&header, sizeof(header));
+    lastFlushMicros = now;
+    isOpen = true;
+  }
+
+  //opens a trace named after unixTime in the directory of its month. FsT has the open,
+  //exists and mkdir of SD.h. FILE_WRITE appends, so a trace left by a session started
+  //in the same second is truncated: a second header in the middle would read as a record
+  template <class FsT>
+  bool begin(FsT &fs, uint16_t address16, uint32_t unixTime, uint32_t now)
+  {
+    fmtLine<32> name;
+    traceDirectory(name, unixTime);
+    if (!fs.exists(name.text()))
+    {
+      fs.mkdir(name.text());
+    }
+    traceFileName(name, unixTime);
+    FileT f = fs.open(name.text(), FILE_WRITE);
+    if (!f)
+    {
+      return false;
+    }
+    if (f.size() > 0)
+    {
+      f.truncate(0);
+    }
+    begin(f, address16, unixTime, now);
+    return true;
+  }
+
+  void write(uint32_t now, uint8_t direction, uint8_t apiId, const uint8_t *body, uint8_t length)
+  {
+    if (!isOpen)
+    {
+      return;
+    }
+    traceRecordHeader record = {now, direction, apiId, length, 0};
+    file.write((const uint8_t *)&record, sizeof(record));
+    file.write(body, length);
+    if (now - lastFlushMicros >= flushMicros)
+    {
+      file.flush();
+      lastFlushMicros = now;
+    }
+  }
+
+  void end()
+  {
+    if (isOpen)
+    {
+      file.close();
+      isOpen = false;
+    }
+  }
+};
+
+//hands request to the radio and taps it. XBeeT and RequestT are the XBee and
+//XBeeRequest of the xbee-arduino library
+template <class XBeeT, class FileT, class RequestT>
+void sendTraced(XBeeT &xbee, traceWriter<FileT> &trace, RequestT &request, uint32_t (*clock)())
+{
+  if (trace.isOpen)
+  {
+    uint8_t body[1 + 255];
+    uint8_t length = request.getFrameDataLength();
+    body[0] = request.getFrameId();
+    for (uint8_t i = 0; i < length; i++)
+    {
+      body[i + 1] = request.getFrameData(i);
+    }
+    trace.write(clock(), traceSent, request.getApiId(), body, length + 1);
+  }
+  xbee.send(request);
+}
+
+//reads from the radio without waiting and taps a complete frame, returns true if one is available
+template <class XBeeT, class FileT>
+bool readTraced(XBeeT &xbee, traceWriter<FileT> &trace, uint32_t (*clock)())
+{
+  xbee.readPacket();
+  if (!xbee.getResponse().isAvailable())
+  {
+    return false;
+  }
+  if (trace.isOpen)
+  {
+    trace.write(clock(), traceReceived, xbee.getResponse().getApiId(), xbee.getResponse().getFrameData(),
+                xbee.getResponse().getFrameDataLength());
+  }
+  return true;
+}
+
+#endif